@@ -15,87 +15,251 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
-#include <time.h>
-#include <unistd.h>
-
-#include <SDL_thread.h>
-
 #include "video.h"
 #include "sprite.h"
+#include "worker.h"
+#include "wsched.h"
+#include "mapfile.h"
+#include "live.h"
 #include "array.h"
 
-#define ARRAY_SIZE	128
-#define UDELAY		500
+#define DOT_STEP	4
+#define TRACE_ORDER	16
+#define REPLAY_CHUNK	256
+
+/* replayed operations per value inserted in live mode, at the default
+ * size (bigger arrays get proportionally more values): */
+#define LIVE_OPS	16
 
 #define GREEN		0x00ff00
+#define RED		0xff0000
 #define BG_COLOR	0x0f0f0f
+#define RUN_COLOR	0x303030
+#define FINAL_COLOR	0x808080
 
-typedef int (* ThreadFunc)(void *);
-typedef void (* SortFunc)(Array *);
+/* colours of the ranges owned by the workers of a parallel sort: */
+#define WORKER_COLORS	8
+
+static const u32 WORKER_PALETTE[WORKER_COLORS] = {
+	0x3399ff, 0xffcc00, 0x00e5e5, 0xff66cc,
+	0xff8800, 0xaa66ff, 0xffffff, 0x99cc33,
+};
 
 struct _Array {
 	ObjectVT parent;
 
 	Sprite *bg;
 	Sprite *dot;
-
-	u16 v[ARRAY_SIZE];
-	bool sorted;
+	Sprite *mark;
+	Sprite *bound;
+	Sprite *fdot;
+	Sprite *wdots[WORKER_COLORS];
+
+	u16 *v;			/* owned by the sort thread */
+	u16 *view;		/* owned by the renderer */
+	u16 *final;		/* the input sorted, as it will end up */
+	u32 n;
+	u32 nfinal;		/* view[0..nfinal) matches final */
+	u32 partial;		/* elements sorted by a session, 0 for all */
+
+	Trace *trace;
+	bool active;		/* a sort-session is running */
+	bool done;		/* the sort thread finished */
+	bool sorted;		/* the trace was entirely replayed */
+
+	u32 marks[2];		/* elements touched by the last event */
+	u8 nmarks;
+
+	u32 ranges[SCHED_MAX_THREADS][2];	/* v[l..r] of every worker */
+	u8 nranges;
+	u8 replaying;		/* worker of the events being replayed */
+
+	u8 *runs;		/* v[k] starts a sorted run */
+	u32 *col_runs;		/* run starts falling in every column */
+	u32 cols;
 
 	u8 algo;
 	u8 kase;
+	u64 seed;		/* of every input of the session */
+
+	Live *live;		/* live mode: v is inserted into it */
+	bool live_mode;
+	u32 inserted;		/* elements of v inserted so far */
+
+	MapFile *file;		/* sorted in place of v, when not NULL */
+	u64 lo, hi;		/* smallest and greatest key of the file */
+	u64 *file_keys;		/* keys of the file drawn, one per column */
+	SortWatch watch;	/* of the run over the file */
+
+	SortStats stats;	/* of the operations replayed so far */
+	SortStats file_stats;	/* of the run over the file */
 
 	Callback callback;
-	SDL_Thread *thd;
+	Worker *worker;
 };
 
-static void _array_sort     (Array *self);
-static void bubble_sort     (Array *self);
-static void selection_sort  (Array *self);
-static void insertion_sort  (Array *self);
-static void quick_sort      (Array *self);
-static void heap_sort       (Array *self);
-
-static void swap	(u16 *a, u16 *b);
-static int  select_min	(u16 *a, int start, int end);
-static int  partition	(u16 *v, int l, int r);
-static void _quick_sort	(u16 *v, int l, int r);
-static void heapify	(u16 *v, int i, int max);
+static void _array_sort       (Array *self);
+static void array_clear_runs  (Array *self);
+static void array_extend_final (Array *self);
+static void array_finish      (Array *self);
 
 INLINE_METHOD static void array_free(Array *self)
 {
-	if (self->thd)
-		SDL_KillThread(self->thd);
+	int i;
+
+	array_stop_sorting(self);
+	worker_free(self->worker);
+
+	for (i=0; i<WORKER_COLORS; ++i)
+		object_free(self->wdots[i]);
+
+	objects_free(self->bg, self->dot, self->mark, self->bound,
+		     self->fdot, NULL);
+	trace_free(self->trace);
+	live_free(self->live);
+	free(self->runs);
+	free(self->final);
+	free(self->col_runs);
+	free(self->file_keys);
+	free(self->watch.keys);
+	free(self->v);
+	free(self->view);
+}
+
+/*
+ * Horizontal position of the `i'-th element.
+ */
+INLINE static s16 array_get_x(const Array *self, u32 i, u16 w)
+{
+	if ((u64)self->n * DOT_STEP <= w)
+		return i * DOT_STEP;
 
-	objects_free(self->bg, self->dot, NULL);
+	return (u64)i * w / self->n;
 }
 
+/*
+ * Dot of the `k'-th element: elements already in their final place are
+ * greyed, those in the range of a worker of a parallel sort take the
+ * colour of that worker.
+ */
+static Sprite *array_get_dot(const Array *self, u32 k)
+{
+	u8 i;
+
+	if (k < self->nfinal)
+		return self->fdot;
+
+	for (i=0; i<self->nranges; ++i)
+		if (self->ranges[i][0] <= k && k <= self->ranges[i][1])
+			return self->wdots[i % WORKER_COLORS];
+
+	return self->dot;
+}
+
+/*
+ * Draw the keys sampled from the file, scaling them to the window height.
+ * The mapping itself is never read while it is being sorted: the sort
+ * thread takes the samples (see array_replay()).
+ */
+static int array_blit_file(Array *self, u16 w, u16 h)
+{
+	u32 i, k;
+	u64 key;
+	s16 y;
+
+	for (i=0; i<self->cols; ++i) {
+		k = (u64)i * self->n / self->cols;
+		key = self->file_keys[i];
+
+		y = h - 2;
+		if (self->hi > self->lo)
+			y -= (double)(key - self->lo) / (self->hi - self->lo) *
+				(h - 2);
+
+		layer_set_xy(self->dot, array_get_x(self, k, w), y);
+		object_blit(self->dot);
+	}
+
+	return 0;
+}
+
+/*
+ * Up to one element every DOT_STEP pixels is drawn; bigger arrays are
+ * downsampled, one element per column.
+ */
 static int array_blit(Array *self)
 {
-	int i;
-	u16 h;
+	Sprite *dot;
+	u32 i, k, cols;
+	u16 w, h;
 	s16 x, y;
 	
+	w = video_get_width();
 	h = video_get_height();
 
 	object_blit(self->bg);
-	for (i=0; i<ARRAY_SIZE; ++i) {
-		x = i * 4;
-		y = h - self->v[i];
-		layer_set_xy(self->dot, x, y);
-		object_blit(self->dot);
+
+	if (self->file)
+		return array_blit_file(self, w, h);
+
+	cols = self->cols;
+
+	for (i=0; i<cols; ++i) {
+		if (!self->col_runs[i])
+			continue;
+		x = array_get_x(self, (u64)i * self->n / cols, w);
+		layer_set_xy(self->bound, x > 0 ? x - 1 : 0, 0);
+		object_blit(self->bound);
+	}
+
+	for (i=0; i<cols; ++i) {
+		k = (u64)i * self->n / cols;
+		if (self->live && k >= live_get_size(self->live))
+			break;
+
+		x = array_get_x(self, k, w);
+		y = h - self->view[k];
+		dot = array_get_dot(self, k);
+		layer_set_xy(dot, x, y);
+		object_blit(dot);
+	}
+
+	for (i=0; i<self->nmarks; ++i) {
+		k = self->marks[i];
+		x = array_get_x(self, k, w);
+		y = h - self->view[k];
+		layer_set_xy(self->mark, x, y);
+		object_blit(self->mark);
 	}
 
 	return 0;
 }
 
-Array *array_new(void)
+/*
+ * Common part of the ctors: everything but the element storage.
+ */
+static Array *array_alloc(u32 n)
 {
 	Array *self;
-
-	srand(time(NULL));
+	int i;
 
 	self = calloc(1, sizeof(Array));
+	if (!self)
+		return NULL;
+
+	self->n = n;
+	self->cols = n < video_get_width() ? n : video_get_width();
+	self->col_runs = calloc(self->cols ? self->cols : 1, sizeof(u32));
+	self->trace = trace_new(TRACE_ORDER);
+	self->worker = worker_new();
+	if (!self->col_runs || !self->trace || !self->worker) {
+		log_err("could not allocate an array of %u elements", n);
+		trace_free(self->trace);
+		worker_free(self->worker);
+		free(self->col_runs);
+		free(self);
+		return NULL;
+	}
 	
 	OBJECT(self)->vtable.dtor = (pfDtor)array_free;
 	OBJECT(self)->vtable.blit = (pfBlit)array_blit;
@@ -103,6 +267,20 @@ Array *array_new(void)
 	self->dot = sprite_new(2, 2);
 	sprite_fill(self->dot, GREEN);
 
+	self->mark = sprite_new(2, 2);
+	sprite_fill(self->mark, RED);
+
+	self->bound = sprite_new(1, video_get_height());
+	sprite_fill(self->bound, RUN_COLOR);
+
+	self->fdot = sprite_new(2, 2);
+	sprite_fill(self->fdot, FINAL_COLOR);
+
+	for (i=0; i<WORKER_COLORS; ++i) {
+		self->wdots[i] = sprite_new(2, 2);
+		sprite_fill(self->wdots[i], WORKER_PALETTE[i]);
+	}
+
 	self->bg = sprite_new(video_get_width(), video_get_height());
 	sprite_fill(self->bg, BG_COLOR);
 	sprite_set_accel(self->bg, BG_COLOR);
@@ -110,256 +288,488 @@ Array *array_new(void)
 	return self;
 }
 
-INLINE void array_sort(Array *self, SortType algo, SortCase kase)
+Array *array_new(u32 n, u64 seed)
 {
-	if (self->thd) {
-		SDL_KillThread(self->thd);
-		self->thd = NULL;
+	Array *self;
+
+	if (n > ARRAY_MAX_SIZE) {
+		log_err("arrays are limited to %u elements", ARRAY_MAX_SIZE);
+		return NULL;
 	}
 
-	self->algo = algo;
-	self->kase = kase;
-	self->thd = SDL_CreateThread((ThreadFunc)_array_sort, self);
+	self = array_alloc(n);
+	if (!self)
+		return NULL;
+
+	self->seed = seed;
+	self->v = calloc(n, sizeof(u16));
+	self->view = calloc(n, sizeof(u16));
+	self->final = calloc(n, sizeof(u16));
+	self->runs = calloc(n, sizeof(u8));
+	if (!self->v || !self->view || !self->final || !self->runs) {
+		log_err("could not allocate an array of %u elements", n);
+		object_free(self);
+		return NULL;
+	}
+
+	return self;
 }
 
-INLINE_METHOD void array_stop_sorting(Array *self)
+/*
+ * Smallest and greatest key of the file, the range drawn.
+ */
+static void array_set_limits(Array *self)
 {
-	if (self->thd) {
-		SDL_KillThread(self->thd);
-		self->thd = NULL;
+	const void *data;
+	SortElem elem;
+	u64 key;
+	u32 i;
+
+	data = mapfile_get_data(self->file);
+	elem = mapfile_get_elem(self->file);
+
+	self->lo = ~0ull;
+	self->hi = 0;
+
+	for (i=0; i<self->n; ++i) {
+		key = sort_elem_key(data, i, elem);
+		if (key < self->lo)
+			self->lo = key;
+		if (key > self->hi)
+			self->hi = key;
 	}
 }
 
-INLINE_METHOD void array_set_callback(Array *self, Callback f)
+/*
+ * Sample the keys drawn straight from the mapping, which nobody else is
+ * writing.
+ */
+static void array_sample_file(Array *self)
 {
-	self->callback = f;
+	const void *data;
+	SortElem elem;
+	u32 i;
+
+	data = mapfile_get_data(self->file);
+	elem = mapfile_get_elem(self->file);
+
+	for (i=0; i<self->cols; ++i)
+		self->file_keys[i] = sort_elem_key(data,
+				(u64)i * self->n / self->cols, elem);
 }
 
-static void _array_sort(Array *self)
+Array *array_new_mapped(MapFile *file)
 {
-	SortFunc f = NULL;
-	int i, x;
+	Array *self;
 
-	self->sorted = 0;
+	self = array_alloc(mapfile_get_size(file));
+	if (!self)
+		return NULL;
 
-	switch (self->kase) {
-	case CASE_RANDOM:
-		for (i=0; i<ARRAY_SIZE; ++i)
-			self->v[i] = rand() % 400;
-		break;
-
-	case CASE_REVERSED:
-		for (i=0; i<ARRAY_SIZE; ++i)
-			self->v[i] = (rand() % 5) + 
-				+ (3 * ARRAY_SIZE - (i+1) * 3);
-		break;
-
-	case CASE_NEARLY_SORTED:
-		for (i=0; i<ARRAY_SIZE; ++i)
-			if (rand() % 3)
-				self->v[i] = i*3;
-			else
-				self->v[i] =  rand() % 400;
-		break;
-
-	case CASE_FEW_UNIQUE:
-		self->v[0] = rand() % 400;
-		self->v[1] = rand() % 400;
-
-		for (i=2; i<ARRAY_SIZE; ++i) {
-			x = rand() % 400;
-			if ((x % 2))
-				self->v[i] = self->v[rand() % i];
-			else
-				self->v[i] = x;
-		}
-		break;
+	self->file_keys = calloc(self->cols, sizeof(u64));
+	self->watch.keys = calloc(self->cols, sizeof(u64));
+	if (!self->file_keys || !self->watch.keys) {
+		log_err("could not allocate the view of the file");
+		object_free(self);
+		return NULL;
+	}
 
-	default:
-		log_fixme("unknown case number: #%d", self->kase);
+	self->file = file;
+
+	self->watch.n = self->n;
+	self->watch.elem = mapfile_get_elem(file);
+	self->watch.nkeys = self->cols;
+
+	array_set_limits(self);
+	array_sample_file(self);
+
+	return self;
+}
+
+void array_sort(Array *self, SortType algo, SortCase kase)
+{
+	array_stop_sorting(self);
+	trace_reset(self->trace);
+
+	self->algo = algo;
+	self->kase = kase;
+
+	/* every session sorts the file as it is on disk: */
+	if (self->file) {
+		if (mapfile_reset(self->file) != 0)
+			return;
+
+		mapfile_advise(self->file, algo);
+		array_sample_file(self);
+		self->watch.v = mapfile_get_data(self->file);
+		self->watch.cancel = 0;
+		self->watch.wanted = 1;
 	}
-		
-	switch (self->algo) {
-	case BUBBLE_SORT:
-		f = bubble_sort;
-		break;
-
-	case SELECTION_SORT:
-		f = selection_sort;		
-		break;
-
-	case INSERTION_SORT:
-		f = insertion_sort;
-		break;
-
-	case QUICK_SORT:
-		f = quick_sort;
-		break;
-
-	case HEAP_SORT:
-		f = heap_sort;
-		break;
-
-	default:
-		log_fixme("wrong algo number: #%d", self->algo);
+	else {
+		sort_fill(self->v, self->n, kase, self->seed);
+		memcpy(self->view, self->v, self->n * sizeof(u16));
+		memcpy(self->final, self->v, self->n * sizeof(u16));
+		sort_run(self->final, self->n, COUNTING_SORT, NULL, NULL);
 	}
 
-	if (f) {
-		f(self);
-		if (self->callback)
-			self->callback(self);
+	self->active = 1;
+	self->done = 0;
+	self->sorted = 0;
+	self->nmarks = 0;
+	self->nranges = 0;
+	self->replaying = 0;
+	self->nfinal = 0;
+	memset(&self->stats, 0, sizeof(self->stats));
+	array_clear_runs(self);
+
+	/* the live mode inserts the input while it is drawn: */
+	live_free(self->live);
+	self->live = NULL;
+	if (self->live_mode && !self->file) {
+		self->live = live_new(self->n, ELEM_U16, algo);
+		self->inserted = 0;
+		if (!self->live)
+			self->active = 0;
+		return;
 	}
+
+	array_extend_final(self);
+
+	worker_submit(self->worker, (WorkFunc)_array_sort, self);
 }
 
-INLINE static void swap(u16 *a, u16 *b)
+/*
+ * Forget the run boundaries.
+ */
+static void array_clear_runs(Array *self)
 {
-	if (*a != *b) {
-		*a ^= *b;
-		*b ^= *a;
-		*a ^= *b;
-	}
+	if (self->runs)
+		memset(self->runs, 0, self->n * sizeof(u8));
+	memset(self->col_runs, 0, self->cols * sizeof(u32));
 }
 
-static int select_min(u16 *a, int start, int end)
+/*
+ * Closing the trace (or cancelling the watch, over a file) is the
+ * cancellation token of the sort thread: it will bail out at its next
+ * safe point.
+ */
+void array_stop_sorting(Array *self)
 {
-	int i, imin;
+	trace_close(self->trace);
+	__atomic_store_n(&self->watch.cancel, 1, __ATOMIC_RELAXED);
+	worker_wait(self->worker);
+	self->active = 0;
 
-	imin = start;
+	if (self->file)
+		array_sample_file(self);
+}
 
-	for (i=start+1; i<=end; ++i) {
-		usleep(UDELAY);
-		if (a[i] < a[imin])
-			imin = i;
-	}
+/*
+ * Mark `k' as the start of a run.
+ */
+static void array_set_bound(Array *self, u32 k)
+{
+	if (self->runs[k])
+		return;
 
-	return imin;
+	self->runs[k] = 1;
+	++self->col_runs[(u64)k * self->cols / self->n];
 }
 
-static int partition(u16 *v, int l, int r)
+/*
+ * Record the sorted run v[l..r]: the boundaries inside it are gone.
+ * The first element is never a boundary.
+ */
+static void array_set_run(Array *self, u32 l, u32 r)
 {
-	int p, i, j;
+	u32 k;
 
-	p = (l+r)/2;
-	swap(&v[p], &v[r]);
-	j = l;
-
-	for (i=l; i<r; ++i) {
-		usleep(UDELAY);
-		if (v[i] <= v[r]) {
-			swap(&v[i], &v[j]);
-			++j;
+	for (k=l+1; k<=r; ++k) {
+		if (self->runs[k]) {
+			self->runs[k] = 0;
+			--self->col_runs[(u64)k * self->cols / self->n];
 		}
 	}
 
-	swap(&v[j], &v[r]);
-	
-	return j;
+	if (l > 0)
+		array_set_bound(self, l);
+	if (r + 1 < self->n)
+		array_set_bound(self, r + 1);
+}
+
+/*
+ * The final prefix of the view: once a write breaks it, it is checked
+ * again from there. Runs over a file are not replayed, so they have none.
+ */
+static void array_extend_final(Array *self)
+{
+	if (self->file)
+		return;
+
+	while (self->nfinal < self->n &&
+	       self->view[self->nfinal] == self->final[self->nfinal])
+		++self->nfinal;
 }
 
-static void _quick_sort(u16 *v, int l, int r)
+INLINE static void array_touch(Array *self, u32 k)
 {
-	int p;
+	if (k < self->nfinal)
+		self->nfinal = k;
+}
 
-	if (l < r) {
-		p = partition(v, l, r);
-		_quick_sort(v, l, p-1);
-		_quick_sort(v, p+1, r);
+/*
+ * Record the range of the worker being replayed.
+ */
+static void array_set_range(Array *self, u32 l, u32 r)
+{
+	u8 i;
+
+	for (i=self->nranges; i<=self->replaying; ++i) {
+		self->ranges[i][0] = 1;
+		self->ranges[i][1] = 0;
 	}
+
+	if (self->nranges <= self->replaying)
+		self->nranges = self->replaying + 1;
+
+	self->ranges[self->replaying][0] = l;
+	self->ranges[self->replaying][1] = r;
 }
 
-static void heapify(u16 *v, int i, int max)
+/*
+ * Live mode: insert the next values of the input, and show the sorted
+ * array as it is so far. Return the operations the inserts stand for.
+ */
+static u32 array_replay_live(Array *self, u32 max)
 {
-	int l, r, gr = i;
+	u32 i, count, size;
+	u64 ops;
 
-	usleep(UDELAY);
+	count = (u64)max * self->n / (LIVE_OPS * ARRAY_DEFAULT_SIZE);
+	if (!count)
+		count = 1;
 
-	l = i * 2 + 1;
-	r = i * 2 + 2;
+	for (i=0; i<count && self->inserted<self->n; ++i)
+		live_insert(self->live, &self->v[self->inserted++]);
 
-	if (l < max && v[l] > v[gr])
-		gr = l;
+	if (self->inserted == self->n)
+		live_flush(self->live);
 
-	if (r < max && v[r] > v[gr])
-		gr = r;
+	size = live_get_size(self->live);
+	memcpy(self->view, live_get_data(self->live), size * sizeof(u16));
 
-	if (gr != i) {
-		swap(v+gr, v+i);
-		heapify(v, gr, max);
-	}
+	if (self->inserted == self->n)
+		array_finish(self);
+
+	/* the inverse of the scale above; every insert asked for pays for
+	 * the whole of `max', what the rounding left included: */
+	if (i == count)
+		return max;
+
+	ops = (u64)i * LIVE_OPS * ARRAY_DEFAULT_SIZE / self->n;
+	return ops < max ? ops : max;
 }
 
-static void bubble_sort(Array *self)
+u32 array_replay(Array *self, u32 max)
 {
-	int i, j;
-	bool swapped;
-
-	swapped = 1;
-	for (i=0; swapped && i<ARRAY_SIZE; ++i) {
-		swapped = 0;
-		for (j=0; j<ARRAY_SIZE-1; ++j) {
-			usleep(UDELAY);
-			if (self->v[j] > self->v[j+1]) {
-				swap(&self->v[j], &self->v[j+1]);
-				swapped = 1;
-			}
+	TraceEvent buf[REPLAY_CHUNK];
+	u32 i, a, b, chunk, count, total;
+	u16 tmp;
+	bool done;
+
+	if (!self->active)
+		return 0;
+
+	if (self->live)
+		return array_replay_live(self, max);
+
+	/* every event is published before `done' is set: */
+	done = __atomic_load_n(&self->done, __ATOMIC_ACQUIRE);
+
+	/* runs over a file are not traced, but watched: the snapshot taken
+	 * is drawn, and the next one asked for: */
+	if (self->file) {
+		if (done) {
+			array_finish(self);
 		}
+		else if (!__atomic_load_n(&self->watch.wanted,
+					  __ATOMIC_ACQUIRE)) {
+			memcpy(self->file_keys, self->watch.keys,
+			       self->cols * sizeof(u64));
+			__atomic_store_n(&self->watch.wanted, 1,
+					 __ATOMIC_RELEASE);
+		}
+		return 0;
 	}
 
-	self->sorted = 1;
+	total = 0;
+	do {
+		chunk = max - total < REPLAY_CHUNK ? max - total : REPLAY_CHUNK;
+		count = trace_pop(self->trace, buf, chunk);
+
+		for (i=0; i<count; ++i) {
+			a = TRACE_EVENT_A(buf[i]);
+			b = TRACE_EVENT_B(buf[i]);
+
+			switch (TRACE_EVENT_OP(buf[i])) {
+			case TRACE_CMP:
+				/* a step on a single element reads its key: */
+				if (a == b) {
+					++self->stats.reads;
+				}
+				else {
+					++self->stats.cmps;
+					self->stats.reads += 2;
+				}
+				break;
+
+			case TRACE_RANGE:
+				array_set_range(self, a, b);
+				continue;
+
+			case TRACE_WORKER:
+				self->replaying = a;
+				continue;
+
+			case TRACE_RUN:
+				array_set_run(self, a, b);
+				continue;
+
+			case TRACE_SWAP:
+				++self->stats.swaps;
+				tmp = self->view[a];
+				self->view[a] = self->view[b];
+				self->view[b] = tmp;
+				array_touch(self, a);
+				array_touch(self, b);
+				break;
+
+			case TRACE_WRITE:
+				++self->stats.moves;
+				self->view[a] = b;
+				array_touch(self, a);
+				self->marks[0] = a;
+				self->nmarks = 1;
+				continue;
+			}
+
+			self->marks[0] = a;
+			self->marks[1] = b;
+			self->nmarks = 2;
+		}
+
+		total += count;
+	} while (count == chunk && total < max);
+
+	array_extend_final(self);
+
+	if (done && count < chunk)
+		array_finish(self);
+
+	return total;
 }
 
-static void selection_sort(Array *self)
+/*
+ * The whole sort-session was replayed.
+ */
+static void array_finish(Array *self)
 {
-	int i, imin;
-
-	for (i=0; i<ARRAY_SIZE; ++i) {
-		imin = select_min(self->v, i, ARRAY_SIZE-1);
-		if (imin != i)
-			swap(&self->v[i], &self->v[imin]);
+	if (self->file) {
+		self->stats = self->file_stats;
+		array_sample_file(self);
 	}
 
+	self->active = 0;
 	self->sorted = 1;
+	self->nmarks = 0;
+	self->nranges = 0;
+	array_clear_runs(self);
+
+	/* a partial session leaves its sorted prefix highlighted: */
+	if (!self->partial)
+		self->nfinal = 0;
+
+	if (self->callback)
+		self->callback(self);
 }
 
-static void insertion_sort(Array *self)
+u32 *array_argsort(const Array *self, SortType algo)
 {
-	int i, j;
-	u16 value;
-
-	for (i=1; i<ARRAY_SIZE; ++i) {
-		j = i - 1;
-		value = self->v[i];
-		
-		while (j>=0 && self->v[j] > value) {
-			usleep(UDELAY);
-			self->v[j+1] = self->v[j];
-			--j;
-		} 
-
-		self->v[j+1] = value;
+	u32 *perm;
+	int retv;
+
+	perm = malloc(self->n * sizeof(u32));
+	if (!perm) {
+		log_err("could not allocate a permutation of %u elements",
+			self->n);
+		return NULL;
 	}
 
-	self->sorted = 1;
+	if (self->file)
+		retv = sort_argsort(mapfile_get_data(self->file), self->n,
+				    mapfile_get_elem(self->file), algo, perm,
+				    NULL);
+	else
+		retv = sort_argsort(self->view, self->n, ELEM_U16, algo, perm,
+				    NULL);
+
+	if (retv != 0) {
+		free(perm);
+		return NULL;
+	}
+
+	return perm;
 }
 
-INLINE static void quick_sort(Array *self)
+INLINE_METHOD void array_set_partial(Array *self, u32 k)
 {
-	_quick_sort(self->v, 0, ARRAY_SIZE-1);
-	self->sorted = 1;
+	self->partial = k < self->n ? k : 0;
 }
 
-static void heap_sort(Array *self)
+INLINE_METHOD void array_set_live(Array *self, bool enable)
 {
-	int i;
+	self->live_mode = enable;
+}
 
-	for (i=ARRAY_SIZE/2-1; i>=0; --i)
-		heapify(self->v, i, ARRAY_SIZE-1);
-    
-	for (i=ARRAY_SIZE-1; i>0; --i) {
-		swap(self->v, self->v+i);
-		heapify(self->v, 0, i);
-	}
+int array_get_live_stats(Array *self, LiveStats *stats)
+{
+	if (!self->live)
+		return -1;
 
-	self->sorted = 1;
+	live_get_stats(self->live, stats);
+
+	return 0;
 }
 
+INLINE_METHOD void array_set_callback(Array *self, Callback f)
+{
+	self->callback = f;
+}
+
+INLINE_METHOD void array_get_stats(const Array *self, SortStats *stats)
+{
+	*stats = self->stats;
+}
+
+static void _array_sort(Array *self)
+{
+	if (self->file)
+		sort_set_watch(&self->watch);
+
+	if (self->file && self->partial)
+		sort_partial(mapfile_get_data(self->file), self->n,
+			     mapfile_get_elem(self->file), self->partial,
+			     self->algo, &self->file_stats);
+	else if (self->file)
+		sort_run_elems(mapfile_get_data(self->file), self->n,
+			       mapfile_get_elem(self->file), self->algo,
+			       &self->file_stats);
+	else if (self->partial)
+		sort_run_partial(self->v, self->n, self->partial, self->algo,
+				 self->trace, NULL);
+	else
+		sort_run(self->v, self->n, self->algo, self->trace, NULL);
+
+	sort_set_watch(NULL);
+	__atomic_store_n(&self->done, 1, __ATOMIC_RELEASE);
+}
@@ -26,32 +26,46 @@
 #define ARRAY_H
 
 #include "object.h"
-
-typedef enum {
-	BUBBLE_SORT,
-	SELECTION_SORT,
-	INSERTION_SORT,
-	QUICK_SORT,
-	HEAP_SORT,
-} SortType;
-
-typedef enum {
-	CASE_RANDOM,
-	CASE_REVERSED,
-	CASE_NEARLY_SORTED,
-	CASE_FEW_UNIQUE,
-} SortCase;
+#include "sort.h"
+#include "mapfile.h"
+#include "live.h"
 
 typedef struct _Array Array;
 typedef void (*Callback)(Array *);
 
+#define ARRAY_DEFAULT_SIZE	128
+#define ARRAY_MAX_SIZE		(TRACE_INDEX_MAX + 1)
+
 /*
  * Array ctor.
+ * `n' is the number of elements to sort (up to ARRAY_MAX_SIZE): the array
+ * storage is allocated once, here, and reused by every sort-session.
+ * Inputs are drawn from `seed': every algorithm sorts the same input of a
+ * given case.
+ * On error a NULL pointer is returned.
+ */
+Array *array_new (u32 n, u64 seed);
+
+/*
+ * Array ctor over the elements of `file', which are drawn (downsampled and
+ * scaled to the window) and sorted right in the mapping, with no copy:
+ * the case of array_sort() is ignored and every session starts from the
+ * content of the file (see mapfile_reset()). These runs are not traced
+ * but watched: their progress is sampled from the mapping at the safe
+ * points of the sort (see sort_set_watch()), and array_stop_sorting()
+ * stops them at the next one. A stopped run leaves the mapping partially
+ * sorted, and so the file with --in-place, but still a permutation of the
+ * elements it started from.
+ * `file' is not owned by the array and must outlive it.
+ * On error a NULL pointer is returned.
  */
-Array *array_new (void);
+Array *array_new_mapped (MapFile *file);
 
 /*
  * Perform array sort using `algo' algorithm for the given case `kase'.
+ * The sort runs at full speed in a separate thread, recording its
+ * operations in a trace; what is drawn is the replay of that trace (see
+ * array_replay()).
  */
 void array_sort (Array *self, SortType algo, SortCase kase);
 
@@ -61,12 +75,60 @@ void array_sort (Array *self, SortType algo, SortCase kase);
  */
 void array_stop_sorting (Array *self);
 
+/*
+ * Replay up to `max' operations of the running sort-session on the drawn
+ * copy of the array, and return how many were replayed.
+ * The speed of the animation depends only on how often and with which
+ * `max' this function is called.
+ */
+u32 array_replay (Array *self, u32 max);
+
+/*
+ * Return the permutation sorting the elements of the array, as they are
+ * drawn (or those of its file), computed by sort_argsort() with `algo':
+ * the elements are not moved. The caller should deallocate it using
+ * free(3). It must not be called while a sort-session is running.
+ * On error a NULL pointer is returned.
+ */
+u32 *array_argsort (const Array *self, SortType algo);
+
+/*
+ * Make the next sort-sessions sort only the `k' smallest elements, by
+ * sort_run_partial() (or sort_partial() over a file) with their
+ * algorithm, leaving the others unsorted after them (`k' = 0 or not less
+ * than the size sorts them all again).
+ * While a session is replayed, the prefix of elements already where they
+ * will end up is greyed; a partial session leaves it so once over.
+ */
+void array_set_partial (Array *self, u32 k);
+
+/*
+ * Live mode (`enable' = 1): the next sort-sessions insert the input, value
+ * after value, into a Live sorted by their algorithm, and array_replay()
+ * draws it as it grows instead of replaying a sort. Arrays over a file
+ * are never live.
+ * array_get_live_stats() stores the counters of the Live of the session
+ * in `stats' and returns 0, or -1 if it is not live.
+ */
+void array_set_live       (Array *self, bool enable);
+int  array_get_live_stats (Array *self, LiveStats *stats);
+
 /*
  * Set the callback function. 
  * When array will be sorted, the object will emit a signal, here you can
  * set the function to catch it.
- * The function will be invoked in a separate thread.
+ * The function is invoked by array_replay(), once the whole sort-session
+ * has been replayed.
  */
 void array_set_callback (Array *self, Callback f);
 
+/*
+ * Store in `stats' the operation counters of the sort-session, as far as
+ * it has been replayed: every step on two elements counts as a comparison
+ * reading both, a step on a single one as the read of its key.
+ * Runs over a file (see array_new_mapped()) are performed by the
+ * instrumented kernels and their counters show up once they are over.
+ */
+void array_get_stats (const Array *self, SortStats *stats);
+
 #endif /* !ARRAY_H */
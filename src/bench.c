@@ -0,0 +1,1003 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "log.h"
+#include "sort.h"
+#include "perf.h"
+#include "vpart.h"
+#include "live.h"
+#include "bench.h"
+
+#define BENCH_SEEDS	3
+#define QUADRATIC_MAX	10000
+
+/* pseudo SortTypes for the libc baseline, the plain-leaf kernels and the
+ * vector quick sort on its scalar partition: */
+#define BENCH_QSORT		SORT_TYPE_COUNT
+#define BENCH_QUICK_PLAIN	(SORT_TYPE_COUNT + 1)
+#define BENCH_MERGE_PLAIN	(SORT_TYPE_COUNT + 2)
+#define BENCH_VECTOR_SCALAR	(SORT_TYPE_COUNT + 3)
+#define BENCH_ALGO_COUNT	(SORT_TYPE_COUNT + 4)
+
+/* selection rows, run against a full intro sort of the same input: */
+#define BENCH_SELECT		BENCH_ALGO_COUNT
+#define BENCH_PARTIAL		(BENCH_ALGO_COUNT + 1)
+#define BENCH_TOPK		(BENCH_ALGO_COUNT + 2)
+#define BENCH_SELECT_END	(BENCH_ALGO_COUNT + 3)
+
+/* inserts into a Live, batches sorted by intro sort: */
+#define BENCH_LIVE		BENCH_SELECT_END
+
+/* elements pushed at a time into the streaming top-k: */
+#define TOPK_CHUNK	4096
+
+static const u32 BENCH_SIZES[] = { 1000, 10000, 100000, 1000000 };
+
+#define BENCH_NSIZES	(sizeof(BENCH_SIZES) / sizeof(*BENCH_SIZES))
+
+typedef struct {
+	int algo;
+	SortCase kase;
+	SortElem elem;
+	u32 n;
+	u32 k;			/* elements selected, 0 for the sorts */
+	u64 seed;
+	u32 threads;
+	u64 gen_ns;		/* to generate the input */
+	u64 ns;
+	double speedup;		/* against the same run on 1 thread, or
+				   the full sort for selections */
+	u64 argsort_ns;		/* to sort the indices instead (0 if none) */
+	double inserts;		/* per second, in live rows (0 if none) */
+	u64 p99_ns;		/* of an insert, in live rows */
+	SortProfile profile;	/* of the timed run, in AUTO_SORT rows */
+	int best;		/* fastest fixed SortType on the same input,
+				   in AUTO_SORT rows (-1 if none) */
+	SortStats stats;
+	PerfSample perf;	/* of the timed run */
+} BenchRow;
+
+/*
+ * Fastest fixed SortType run on an input, to compare AUTO_SORT with.
+ */
+typedef struct {
+	u64 ns;			/* 0 if none yet */
+	int algo;
+} BenchBest;
+
+static u64 qsort_cmps;
+static Perf *perf;
+static u32 *perm;
+static BenchBest best[SORT_CASE_COUNT][BENCH_NSIZES][BENCH_SEEDS];
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * qsort(3) comparators of every element type, plain and counting.
+ */
+#define SCALAR(P)	(*(P))
+#define RECORD_KEY(P)	((P)->key)
+
+#define COMPARE(NAME, TYPE, KEY)					\
+static int compare_##NAME(const void *a, const void *b)			\
+{									\
+	const TYPE *x = a, *y = b;					\
+									\
+	return (KEY(x) > KEY(y)) - (KEY(x) < KEY(y));			\
+}									\
+									\
+static int compare_##NAME##_counted(const void *a, const void *b)	\
+{									\
+	++qsort_cmps;							\
+	return compare_##NAME(a, b);					\
+}
+
+typedef int (* Compare)(const void *, const void *);
+
+COMPARE(u16, u16, SCALAR)
+COMPARE(u32, u32, SCALAR)
+COMPARE(u64, u64, SCALAR)
+COMPARE(float, float, SCALAR)
+COMPARE(double, double, SCALAR)
+COMPARE(record, SortRecord, RECORD_KEY)
+
+static const Compare COMPARE_PLAIN[SORT_ELEM_COUNT] = {
+	compare_u16, compare_u32, compare_u64,
+	compare_float, compare_double, compare_record,
+};
+
+UNUSED static const Compare COMPARE_COUNTED[SORT_ELEM_COUNT] = {
+	compare_u16_counted, compare_u32_counted, compare_u64_counted,
+	compare_float_counted, compare_double_counted, compare_record_counted,
+};
+
+INLINE static const char *algo_name(int algo)
+{
+	switch (algo) {
+	case BENCH_QSORT:
+		return "qsort";
+
+	case BENCH_QUICK_PLAIN:
+		return "quick sort (plain leaves)";
+
+	case BENCH_MERGE_PLAIN:
+		return "merge sort (plain leaves)";
+
+	case BENCH_VECTOR_SCALAR:
+		return "vector quick sort (scalar)";
+
+	case BENCH_SELECT:
+		return "select";
+
+	case BENCH_PARTIAL:
+		return "partial sort";
+
+	case BENCH_TOPK:
+		return "streaming top-k";
+
+	case BENCH_LIVE:
+		return "live insert";
+	}
+
+	return sort_algo_name(algo);
+}
+
+/*
+ * Sort `v' with `algo', which may be one of the pseudo SortTypes.
+ */
+static void bench_sort(int algo, SortElem elem, void *v, u32 n,
+		       SortStats *stats)
+{
+	VpartIsa isa;
+
+	switch (algo) {
+	case BENCH_QUICK_PLAIN:
+	case BENCH_MERGE_PLAIN:
+		sort_set_leaves(0);
+		sort_run_elems(v, n, elem,
+			       algo == BENCH_QUICK_PLAIN ? QUICK_SORT : MERGE_SORT,
+			       stats);
+		sort_set_leaves(1);
+		break;
+
+	case BENCH_VECTOR_SCALAR:
+		isa = vpart_get_isa();
+		vpart_set_isa(VPART_SCALAR);
+		sort_run_elems(v, n, elem, VECTOR_QUICK_SORT, stats);
+		vpart_set_isa(isa);
+		break;
+
+	default:
+		sort_run_elems(v, n, elem, algo, stats);
+	}
+}
+
+INLINE static bool is_parallel(int algo)
+{
+	return algo == PARALLEL_QUICK_SORT || algo == PARALLEL_MERGE_SORT ||
+		algo == PARALLEL_SAMPLE_SORT;
+}
+
+INLINE static bool is_quadratic(int algo)
+{
+	return algo == BUBBLE_SORT || algo == SELECTION_SORT ||
+		algo == INSERTION_SORT;
+}
+
+/*
+ * Quick sort takes the middle element as pivot, which degenerates on the
+ * organ pipe (it is the greatest key) and on the sawtooth (the smallest
+ * key of a tooth), and its Lomuto partition on runs of equal keys (the
+ * cases drawing from a few hundred keys at most).
+ */
+INLINE static bool is_degenerate(int algo, SortCase kase)
+{
+	switch (algo) {
+	case QUICK_SORT:
+	case BENCH_QUICK_PLAIN:
+		return kase == CASE_ALL_EQUAL || kase == CASE_FEW_UNIQUE ||
+			kase == CASE_ZIPF || kase == CASE_SAWTOOTH ||
+			kase == CASE_ORGAN_PIPE;
+	}
+
+	return 0;
+}
+
+static void print_header(int format)
+{
+	if (format == BENCH_FORMAT_JSON)
+		printf("[\n");
+	else
+		printf("algo,case,type,n,k,seed,threads,gen_ns,ns,ns_per_elem,"
+		       "speedup,argsort_ns,indirection,inserts_per_sec,"
+		       "p99_insert_ns,choice,profile_ns,best_fixed,"
+		       "cmps,reads,swaps,moves,"
+		       "cycles,instructions,ipc,"
+		       "l1d_misses_per_elem,llc_misses_per_elem,"
+		       "branch_misses_per_elem,dtlb_misses_per_elem\n");
+}
+
+/*
+ * Hardware counters the bench reports, normalized per element.
+ */
+static const struct {
+	PerfCounter counter;
+	const char *name;
+} PER_ELEM[] = {
+	{ PERF_L1D_MISSES, "l1d_misses_per_elem" },
+	{ PERF_LLC_MISSES, "llc_misses_per_elem" },
+	{ PERF_BRANCH_MISSES, "branch_misses_per_elem" },
+	{ PERF_DTLB_MISSES, "dtlb_misses_per_elem" },
+};
+
+#define NPER_ELEM	(sizeof(PER_ELEM) / sizeof(*PER_ELEM))
+
+/*
+ * Print the hardware counters of `row': unavailable ones are empty fields
+ * in CSV and nulls in JSON. So are all of them on more than one thread,
+ * where they would only cover the share of worker 0 (see bench_one()).
+ */
+static void print_perf(int format, const BenchRow *row)
+{
+	static const PerfSample blank;
+	const PerfSample *p = row->threads > 1 ? &blank : &row->perf;
+	bool json = format == BENCH_FORMAT_JSON;
+	const char *none = json ? "null" : "";
+	u32 i;
+
+	printf(json ? ", \"cycles\": " : ",");
+	if (p->valid[PERF_CYCLES])
+		printf("%llu", (unsigned long long)p->value[PERF_CYCLES]);
+	else
+		printf("%s", none);
+
+	printf(json ? ", \"instructions\": " : ",");
+	if (p->valid[PERF_INSTRUCTIONS])
+		printf("%llu",
+		       (unsigned long long)p->value[PERF_INSTRUCTIONS]);
+	else
+		printf("%s", none);
+
+	printf(json ? ", \"ipc\": " : ",");
+	if (p->valid[PERF_CYCLES] && p->valid[PERF_INSTRUCTIONS] &&
+	    p->value[PERF_CYCLES])
+		printf("%.3f", (double)p->value[PERF_INSTRUCTIONS] /
+		       p->value[PERF_CYCLES]);
+	else
+		printf("%s", none);
+
+	for (i=0; i<NPER_ELEM; ++i) {
+		if (json)
+			printf(", \"%s\": ", PER_ELEM[i].name);
+		else
+			printf(",");
+
+		if (p->valid[PER_ELEM[i].counter])
+			printf("%.4f",
+			       (double)p->value[PER_ELEM[i].counter] / row->n);
+		else
+			printf("%s", none);
+	}
+}
+
+static void print_footer(int format)
+{
+	if (format == BENCH_FORMAT_JSON)
+		printf("\n]\n");
+}
+
+static void print_row(int format, const BenchRow *row, bool first)
+{
+	double per_elem = (double)row->ns / row->n;
+	double indirection = row->ns ? (double)row->argsort_ns / row->ns : 0;
+
+	if (format == BENCH_FORMAT_JSON) {
+		printf("%s  { \"algo\": \"%s\", \"case\": \"%s\", "
+		       "\"type\": \"%s\", \"n\": %u, ",
+		       first ? "" : ",\n",
+		       algo_name(row->algo), sort_case_name(row->kase),
+		       sort_elem_name(row->elem), row->n);
+
+		if (row->k)
+			printf("\"k\": %u, ", row->k);
+		else
+			printf("\"k\": null, ");
+
+		printf("\"seed\": %llu, \"threads\": %u, "
+		       "\"gen_ns\": %llu, \"ns\": %llu, \"ns_per_elem\": %.3f, "
+		       "\"speedup\": %.3f, ",
+		       (unsigned long long)row->seed, row->threads,
+		       (unsigned long long)row->gen_ns,
+		       (unsigned long long)row->ns, per_elem, row->speedup);
+
+		if (row->argsort_ns)
+			printf("\"argsort_ns\": %llu, \"indirection\": %.3f, ",
+			       (unsigned long long)row->argsort_ns,
+			       indirection);
+		else
+			printf("\"argsort_ns\": null, \"indirection\": null, ");
+
+		if (row->inserts)
+			printf("\"inserts_per_sec\": %.0f, "
+			       "\"p99_insert_ns\": %llu, ", row->inserts,
+			       (unsigned long long)row->p99_ns);
+		else
+			printf("\"inserts_per_sec\": null, "
+			       "\"p99_insert_ns\": null, ");
+
+		if (row->algo == AUTO_SORT)
+			printf("\"choice\": \"%s\", \"profile_ns\": %llu, ",
+			       sort_algo_name(row->profile.choice),
+			       (unsigned long long)row->profile.ns);
+		else
+			printf("\"choice\": null, \"profile_ns\": null, ");
+
+		if (row->algo == AUTO_SORT && row->best >= 0)
+			printf("\"best_fixed\": \"%s\", ",
+			       sort_algo_name(row->best));
+		else
+			printf("\"best_fixed\": null, ");
+
+		printf("\"cmps\": %llu, \"reads\": %llu, ",
+		       (unsigned long long)row->stats.cmps,
+		       (unsigned long long)row->stats.reads);
+
+		/* qsort(3) does not tell how it moves data around: */
+		if (row->algo == BENCH_QSORT)
+			printf("\"swaps\": null, \"moves\": null");
+		else
+			printf("\"swaps\": %llu, \"moves\": %llu",
+			       (unsigned long long)row->stats.swaps,
+			       (unsigned long long)row->stats.moves);
+
+		print_perf(format, row);
+		printf(" }");
+	}
+	else {
+		printf("%s,%s,%s,%u,", algo_name(row->algo),
+		       sort_case_name(row->kase), sort_elem_name(row->elem),
+		       row->n);
+
+		if (row->k)
+			printf("%u,", row->k);
+		else
+			printf(",");
+
+		printf("%llu,%u,%llu,%llu,%.3f,%.3f,",
+		       (unsigned long long)row->seed, row->threads,
+		       (unsigned long long)row->gen_ns,
+		       (unsigned long long)row->ns, per_elem, row->speedup);
+
+		if (row->argsort_ns)
+			printf("%llu,%.3f,", (unsigned long long)row->argsort_ns,
+			       indirection);
+		else
+			printf(",,");
+
+		if (row->inserts)
+			printf("%.0f,%llu,", row->inserts,
+			       (unsigned long long)row->p99_ns);
+		else
+			printf(",,");
+
+		if (row->algo == AUTO_SORT)
+			printf("%s,%llu,", sort_algo_name(row->profile.choice),
+			       (unsigned long long)row->profile.ns);
+		else
+			printf(",,");
+
+		if (row->algo == AUTO_SORT && row->best >= 0)
+			printf("%s,", sort_algo_name(row->best));
+		else
+			printf(",");
+
+		printf("%llu,%llu,", (unsigned long long)row->stats.cmps,
+		       (unsigned long long)row->stats.reads);
+
+		if (row->algo == BENCH_QSORT)
+			printf(",");
+		else
+			printf("%llu,%llu",
+			       (unsigned long long)row->stats.swaps,
+			       (unsigned long long)row->stats.moves);
+
+		print_perf(format, row);
+		printf("\n");
+	}
+
+	fflush(stdout);
+}
+
+/*
+ * Return 1 if `perm' sorts `v'.
+ */
+static bool is_argsorted(const void *v, const u32 *perm, u32 n,
+			 SortElem elem)
+{
+	u32 i;
+
+	for (i=1; i<n; ++i)
+		if (sort_elem_key(v, perm[i], elem) <
+		    sort_elem_key(v, perm[i-1], elem))
+			return 0;
+
+	return 1;
+}
+
+/*
+ * Slot of the fastest fixed SortType on the input of `row': sizes out of
+ * BENCH_SIZES are benchmarked alone, in the first slot, and the seeds of
+ * a run are consecutive.
+ */
+static BenchBest *best_of(const BenchRow *row)
+{
+	u32 i;
+
+	for (i=0; i<BENCH_NSIZES && BENCH_SIZES[i]!=row->n; ++i)
+		;
+
+	return &best[row->kase][i < BENCH_NSIZES ? i : 0]
+		[row->seed % BENCH_SEEDS];
+}
+
+/*
+ * Time one run over a copy of `src', reading the hardware counters around
+ * it, and the argsort of `src' by the same algorithm; then repeat the run
+ * with the instrumented kernels to collect the operation counters (left
+ * to 0 by NO_SORT_STATS builds).
+ *
+ * The hardware counters follow the calling thread only: for the parallel
+ * algorithms they count what worker 0 did, and are not reported beyond
+ * one thread.
+ *
+ * The fixed SortTypes keep the fastest run of every input in `best', and
+ * the AUTO_SORT runs, last, report their speedup over it.
+ */
+static int bench_one(BenchRow *row, const void *src, void *work)
+{
+	size_t size = row->n * sort_elem_size(row->elem);
+	BenchBest *b;
+	u64 t0;
+	int retv = 0;
+
+	memcpy(work, src, size);
+
+	perf_start(perf);
+	t0 = now_ns();
+	if (row->algo == BENCH_QSORT)
+		qsort(work, row->n, sort_elem_size(row->elem),
+		      COMPARE_PLAIN[row->elem]);
+	else
+		bench_sort(row->algo, row->elem, work, row->n, NULL);
+	row->ns = now_ns() - t0;
+	perf_stop(perf, &row->perf);
+
+	if (!sort_elems_sorted(work, row->n, row->elem)) {
+		log_err("bench: %s on %s %s input (n=%u, seed=%llu) did not "
+			"sort", algo_name(row->algo), sort_case_name(row->kase),
+			sort_elem_name(row->elem), row->n,
+			(unsigned long long)row->seed);
+		retv = -1;
+	}
+	else if (row->algo < AUTO_SORT) {
+		b = best_of(row);
+		if (!b->ns || row->ns < b->ns) {
+			b->ns = row->ns;
+			b->algo = row->algo;
+		}
+	}
+
+	/* the argsort below runs AUTO_SORT again: */
+	if (row->algo == AUTO_SORT) {
+		sort_get_profile(&row->profile);
+		b = best_of(row);
+		row->best = b->ns ? b->algo : -1;
+		row->speedup = b->ns && row->ns ? (double)b->ns / row->ns : 0;
+	}
+
+	/* qsort(3) and the pseudo SortTypes have no argsort: */
+	row->argsort_ns = 0;
+	if (row->algo < SORT_TYPE_COUNT) {
+		t0 = now_ns();
+		if (sort_argsort(src, row->n, row->elem, row->algo, perm,
+				 NULL) == 0)
+			row->argsort_ns = now_ns() - t0;
+
+		if (row->argsort_ns &&
+		    !is_argsorted(src, perm, row->n, row->elem)) {
+			log_err("bench: the argsort of %s on %s %s input "
+				"(n=%u, seed=%llu) does not sort it",
+				algo_name(row->algo),
+				sort_case_name(row->kase),
+				sort_elem_name(row->elem), row->n,
+				(unsigned long long)row->seed);
+			retv = -1;
+		}
+	}
+
+	memset(&row->stats, 0, sizeof(row->stats));
+
+#ifndef NO_SORT_STATS
+	memcpy(work, src, size);
+
+	if (row->algo == BENCH_QSORT) {
+		qsort_cmps = 0;
+		qsort(work, row->n, sort_elem_size(row->elem),
+		      COMPARE_COUNTED[row->elem]);
+		row->stats.cmps = qsort_cmps;
+		row->stats.reads = 2 * qsort_cmps;
+	}
+	else {
+		bench_sort(row->algo, row->elem, work, row->n, &row->stats);
+	}
+#endif
+
+	return retv;
+}
+
+/*
+ * Run a parallel algorithm on 1, 2, 4... up to `max' threads, reporting
+ * the speedup of every run against the single-threaded one.
+ */
+static int bench_threads(int format, BenchRow *row, u32 max,
+			 const void *src, void *work, bool *first)
+{
+	u64 base;
+	int retv = 0;
+
+	base = 0;
+	row->threads = 1;
+
+	for (;;) {
+		if (sort_set_threads(row->threads) != 0)
+			return -1;
+
+		retv |= bench_one(row, src, work);
+		if (row->threads == 1)
+			base = row->ns;
+
+		row->speedup = row->ns ? (double)base / row->ns : 0;
+		print_row(format, row, *first);
+		*first = 0;
+
+		if (row->threads == max)
+			break;
+
+		row->threads *= 2;
+		if (row->threads > max)
+			row->threads = max;
+	}
+
+	return retv;
+}
+
+/*
+ * Run `algo' on every case, size and seed.
+ */
+static int bench_algo(int format, int algo, SortElem elem, u64 seed,
+		      const u32 *sizes, u32 nsizes, void *src, void *work,
+		      bool *first)
+{
+	BenchRow row;
+	u32 i, threads;
+	u64 t0;
+	int retv = 0;
+
+	row.algo = algo;
+	row.elem = elem;
+	row.k = 0;
+	row.inserts = 0;
+	row.threads = 1;
+	row.speedup = 1;
+	threads = sort_get_threads();
+
+	for (row.kase=0; row.kase<SORT_CASE_COUNT; ++row.kase) {
+		for (i=0; i<nsizes; ++i) {
+			row.n = sizes[i];
+			if ((is_quadratic(algo) ||
+			     is_degenerate(algo, row.kase)) &&
+			    row.n > QUADRATIC_MAX)
+				continue;
+
+			for (row.seed=seed; row.seed<seed+BENCH_SEEDS;
+			     ++row.seed) {
+				t0 = now_ns();
+				sort_fill_elems(src, row.n, elem, row.kase,
+						row.seed);
+				row.gen_ns = now_ns() - t0;
+
+				if (is_parallel(algo)) {
+					retv |= bench_threads(format, &row,
+							      threads, src,
+							      work, first);
+					continue;
+				}
+
+				retv |= bench_one(&row, src, work);
+				print_row(format, &row, *first);
+				*first = 0;
+			}
+		}
+	}
+
+	if (is_parallel(algo))
+		sort_set_threads(threads);
+
+	return retv;
+}
+
+INLINE static void stats_add(SortStats *sum, const SortStats *stats)
+{
+	sum->cmps += stats->cmps;
+	sum->swaps += stats->swaps;
+	sum->moves += stats->moves;
+	sum->reads += stats->reads;
+}
+
+/*
+ * Run the selection of `row' on `work', a copy of `src': the `k' smallest
+ * elements end up in work[0..k), in order but for BENCH_SELECT. The
+ * streaming top-k is fed `src' by chunks of TOPK_CHUNK elements.
+ * Return 0, or -1 on error.
+ */
+static int bench_selection(const BenchRow *row, const void *src, void *work,
+			   SortStats *stats)
+{
+	size_t elem_size = sort_elem_size(row->elem);
+	SortStats chunk;
+	SortTopK *topk;
+	u32 i, m;
+
+	switch (row->algo) {
+	case BENCH_SELECT:
+		sort_select(work, row->n, row->elem, row->k - 1, stats);
+		return 0;
+
+	case BENCH_PARTIAL:
+		sort_partial(work, row->n, row->elem, row->k, INTRO_SORT,
+			     stats);
+		return 0;
+	}
+
+	topk = sort_topk_new(row->k, row->elem);
+	if (!topk)
+		return -1;
+
+	if (stats)
+		memset(stats, 0, sizeof(*stats));
+
+	for (i=0; i<row->n; i+=m) {
+		m = row->n - i < TOPK_CHUNK ? row->n - i : TOPK_CHUNK;
+		sort_topk_push(topk, (const char *)src + i * elem_size, m,
+			       stats ? &chunk : NULL);
+		if (stats)
+			stats_add(stats, &chunk);
+	}
+
+	sort_topk_get(topk, work);
+	sort_topk_free(topk);
+
+	return 0;
+}
+
+/*
+ * Return 1 if work[0..k) holds the `k' smallest keys of `sorted', the
+ * input sorted: in order, or only the greatest of them in place when
+ * `ordered' is 0.
+ */
+static bool is_selected(const void *work, const void *sorted, u32 k,
+			SortElem elem, bool ordered)
+{
+	u64 top;
+	u32 i;
+
+	top = sort_elem_key(sorted, k-1, elem);
+	if (sort_elem_key(work, k-1, elem) != top)
+		return 0;
+
+	for (i=0; i<k-1; ++i) {
+		if (ordered ? sort_elem_key(work, i, elem) !=
+			      sort_elem_key(sorted, i, elem)
+			    : sort_elem_key(work, i, elem) > top)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Time the selection of `row' and check it, then count its operations as
+ * bench_one() does.
+ */
+static int bench_select_one(BenchRow *row, const void *src, void *work,
+			    const void *sorted)
+{
+	size_t size = row->n * sort_elem_size(row->elem);
+	u64 t0;
+	int retv;
+
+	memcpy(work, src, size);
+
+	perf_start(perf);
+	t0 = now_ns();
+	retv = bench_selection(row, src, work, NULL);
+	row->ns = now_ns() - t0;
+	perf_stop(perf, &row->perf);
+
+	if (retv == 0 && !is_selected(work, sorted, row->k, row->elem,
+				      row->algo != BENCH_SELECT)) {
+		log_err("bench: %s of %u on %s %s input (n=%u, seed=%llu) "
+			"did not select them", algo_name(row->algo), row->k,
+			sort_case_name(row->kase), sort_elem_name(row->elem),
+			row->n, (unsigned long long)row->seed);
+		retv = -1;
+	}
+
+	memset(&row->stats, 0, sizeof(row->stats));
+
+#ifndef NO_SORT_STATS
+	memcpy(work, src, size);
+	bench_selection(row, src, work, &row->stats);
+#endif
+
+	return retv;
+}
+
+/*
+ * Run every selection of `row->k' elements, `base' being the time of the
+ * full sort.
+ */
+static int bench_select_k(int format, BenchRow *row, u64 base,
+			  const void *src, void *work, const void *sorted,
+			  bool *first)
+{
+	int retv = 0;
+
+	for (row->algo=BENCH_SELECT; row->algo<BENCH_SELECT_END; ++row->algo) {
+		retv |= bench_select_one(row, src, work, sorted);
+		row->speedup = row->ns ? (double)base / row->ns : 0;
+		print_row(format, row, *first);
+		*first = 0;
+	}
+
+	return retv;
+}
+
+/*
+ * Run the selections of k = 1, 10, 1% and 10% of the elements on every
+ * case, size and seed, reporting their speedup over the full intro sort
+ * of the same input.
+ */
+static int bench_selections(int format, SortElem elem, u64 seed,
+			    const u32 *sizes, u32 nsizes, void *src,
+			    void *work, void *sorted, bool *first)
+{
+	BenchRow row;
+	u32 i, j, ks[4], prev;
+	u64 t0, base;
+	int retv = 0;
+
+	row.elem = elem;
+	row.threads = 1;
+	row.argsort_ns = 0;
+	row.inserts = 0;
+
+	for (row.kase=0; row.kase<SORT_CASE_COUNT; ++row.kase) {
+		for (i=0; i<nsizes; ++i) {
+			row.n = sizes[i];
+			ks[0] = 1;
+			ks[1] = 10;
+			ks[2] = row.n / 100;
+			ks[3] = row.n / 10;
+
+			for (row.seed=seed; row.seed<seed+BENCH_SEEDS;
+			     ++row.seed) {
+				t0 = now_ns();
+				sort_fill_elems(src, row.n, elem, row.kase,
+						row.seed);
+				row.gen_ns = now_ns() - t0;
+
+				memcpy(sorted, src,
+				       row.n * sort_elem_size(elem));
+				t0 = now_ns();
+				sort_run_elems(sorted, row.n, elem, INTRO_SORT,
+					       NULL);
+				base = now_ns() - t0;
+
+				/* small arrays give the same k twice: */
+				for (prev=0, j=0; j<4; prev=ks[j++]) {
+					row.k = ks[j];
+					if (!row.k || row.k == prev ||
+					    row.k > row.n)
+						continue;
+
+					retv |= bench_select_k(format, &row,
+							       base, src, work,
+							       sorted, first);
+				}
+			}
+		}
+	}
+
+	return retv;
+}
+
+/*
+ * Insert `src' value after value into a Live, timing the whole of it
+ * (the last batch is flushed) and reading the hardware counters around
+ * it. Only the moves of the merges are counted.
+ */
+static int bench_live_one(BenchRow *row, const void *src)
+{
+	size_t elem_size = sort_elem_size(row->elem);
+	LiveStats st;
+	Live *live;
+	u32 i;
+	u64 t0;
+	int retv = 0;
+
+	live = live_new(row->n, row->elem, INTRO_SORT);
+	if (!live)
+		return -1;
+
+	perf_start(perf);
+	t0 = now_ns();
+	for (i=0; i<row->n; ++i)
+		live_insert(live, (const char *)src + i * elem_size);
+	live_flush(live);
+	row->ns = now_ns() - t0;
+	perf_stop(perf, &row->perf);
+
+	if (live_get_size(live) != row->n ||
+	    !sort_elems_sorted(live_get_data(live), row->n, row->elem)) {
+		log_err("bench: live inserts of %s %s input (n=%u, seed=%llu) "
+			"are not sorted", sort_case_name(row->kase),
+			sort_elem_name(row->elem), row->n,
+			(unsigned long long)row->seed);
+		retv = -1;
+	}
+
+	live_get_stats(live, &st);
+	row->inserts = st.ns ? st.inserts * 1e9 / st.ns : 0;
+	row->p99_ns = st.p99_ns;
+
+	memset(&row->stats, 0, sizeof(row->stats));
+	row->stats.moves = st.moves;
+
+	live_free(live);
+
+	return retv;
+}
+
+/*
+ * Run the live inserts on every case, size and seed.
+ */
+static int bench_live(int format, SortElem elem, u64 seed, const u32 *sizes,
+		      u32 nsizes, void *src, bool *first)
+{
+	BenchRow row;
+	u32 i;
+	u64 t0;
+	int retv = 0;
+
+	row.algo = BENCH_LIVE;
+	row.elem = elem;
+	row.k = 0;
+	row.threads = 1;
+	row.speedup = 1;
+	row.argsort_ns = 0;
+
+	for (row.kase=0; row.kase<SORT_CASE_COUNT; ++row.kase) {
+		for (i=0; i<nsizes; ++i) {
+			row.n = sizes[i];
+
+			for (row.seed=seed; row.seed<seed+BENCH_SEEDS;
+			     ++row.seed) {
+				t0 = now_ns();
+				sort_fill_elems(src, row.n, elem, row.kase,
+						row.seed);
+				row.gen_ns = now_ns() - t0;
+
+				retv |= bench_live_one(&row, src);
+				print_row(format, &row, *first);
+				*first = 0;
+			}
+		}
+	}
+
+	return retv;
+}
+
+int bench_run(int format, u32 size, SortElem elem, u64 seed)
+{
+	const u32 *sizes;
+	void *src, *work, *sorted;
+	u32 nsizes, max_n, i;
+	bool first;
+	int algo, retv = 0;
+
+	if (size) {
+		sizes = &size;
+		nsizes = 1;
+	}
+	else {
+		sizes = BENCH_SIZES;
+		nsizes = BENCH_NSIZES;
+	}
+
+	max_n = 0;
+	for (i=0; i<nsizes; ++i)
+		if (sizes[i] > max_n)
+			max_n = sizes[i];
+
+	src = malloc((size_t)max_n * sort_elem_size(elem));
+	work = malloc((size_t)max_n * sort_elem_size(elem));
+	sorted = malloc((size_t)max_n * sort_elem_size(elem));
+	perm = malloc((size_t)max_n * sizeof(u32));
+	perf = perf_new();
+	if (!src || !work || !sorted || !perm || !perf) {
+		log_err("bench: could not allocate %u elements", max_n);
+		free(src);
+		free(work);
+		free(sorted);
+		free(perm);
+		perf_free(perf);
+		return -1;
+	}
+
+	log_info("bench: vector partitions on %s (u16 keys on %s)",
+		 vpart_isa_name(vpart_get_isa()),
+		 vpart_isa_name(vpart_get_isa_u16()));
+
+	/* the rows tell the choices of AUTO_SORT: */
+	memset(best, 0, sizeof(best));
+	sort_set_auto_log(0);
+
+	print_header(format);
+	first = 1;
+
+	for (algo=0; algo<BENCH_ALGO_COUNT; ++algo)
+		retv |= bench_algo(format, algo, elem, seed, sizes, nsizes,
+				   src, work, &first);
+
+	retv |= bench_selections(format, elem, seed, sizes, nsizes, src,
+				 work, sorted, &first);
+	retv |= bench_live(format, elem, seed, sizes, nsizes, src, &first);
+
+	print_footer(format);
+	sort_set_auto_log(1);
+
+	free(src);
+	free(work);
+	free(sorted);
+	free(perm);
+	perm = NULL;
+	perf_free(perf);
+	perf = NULL;
+
+	return retv;
+}
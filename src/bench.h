@@ -0,0 +1,53 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "stdinc.h"
+#include "sort.h"
+
+enum BenchFormat {
+	BENCH_FORMAT_CSV,
+	BENCH_FORMAT_JSON,
+};
+
+/*
+ * Headless benchmark: run every SortType against every SortCase over a set
+ * of sizes and seeds, with no video and no delays, and print the report on
+ * stdout using `format' (one of BenchFormat).
+ * If `size' is not 0 only arrays of `size' elements are sorted, otherwise
+ * the default set of sizes is used. Arrays hold elements of type `elem'
+ * (one of SortElem): the same values are drawn whatever the type, so that
+ * runs differ only by the width of the elements.
+ * Every input is drawn from one of three seeds from `seed' on, and
+ * the time spent generating it is reported apart from the sort time.
+ * libc qsort(3) is included as a baseline, and quick sort and merge sort
+ * are also run without their sorting-network leaves.
+ * Parallel algorithms are run on 1, 2, 4... up to sort_get_threads()
+ * threads and their speedup over the single-threaded run is reported.
+ * AUTO_SORT rows report the kernel it chose and its speedup over the
+ * fastest of the other SortTypes on the same input.
+ * The selections of the 1, 10, 1% and 10% smallest elements follow, with
+ * their speedup over a full intro sort of the same input.
+ * Last, every input is inserted value by value into a Live, with the
+ * inserts per second and the 99th percentile latency of an insert.
+ * bench_run() returns 0 on success, -1 if some run did not sort its input.
+ */
+int bench_run (int format, u32 size, SortElem elem, u64 seed);
+
+#endif /* !BENCH_H */
@@ -0,0 +1,373 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#include "log.h"
+#include "dist.h"
+
+/* counters generated at once (a multiple of 4): */
+#define DIST_BATCH	64
+
+/* Philox4x32-10 multipliers and Weyl increments of the key: */
+#define PHILOX_M0	0xd2511f53u
+#define PHILOX_M1	0xcd9e8d57u
+#define PHILOX_W0	0x9e3779b9u
+#define PHILOX_W1	0xbb67ae85u
+#define PHILOX_ROUNDS	10
+
+/* distinct values of CASE_FEW_UNIQUE: */
+#define FEW_UNIQUE	8
+
+/* teeth of CASE_SAWTOOTH, runs of CASE_SORTED_RUNS: */
+#define SAW_TEETH	8
+#define SORTED_RUNS	16
+
+/* largest distance of an element from its place in CASE_K_SORTED: */
+#define K_SORTED	16
+
+/* units of noise over the ramp of CASE_REVERSED: */
+#define REVERSED_NOISE	5
+
+/* slices of the search table of CASE_ZIPF: */
+#define ZIPF_SLICES	1024
+
+/*
+ * The `i'-th element gets the words 2*(i%2) and 2*(i%2)+1 of the counter
+ * i/2, below 2^32: the words drawn for whole blocks of elements live in
+ * the upper domains.
+ */
+#define DOMAIN(D, I)	((u64)(D) << 32 | (I))
+
+/* `j'-th word of a batch, and 64-bit word of its `j'-th element: */
+#define WORD(R, J)	((R)[(J) & 3][(J) >> 2])
+#define WORD64(R, J)	((u64)(R)[((J) & 1) * 2][(J) >> 1] << 32 |	\
+			 (R)[((J) & 1) * 2 + 1][(J) >> 1])
+
+enum {
+	DOMAIN_ELEMENT,
+	DOMAIN_FEW_UNIQUE,
+	DOMAIN_K_SORTED,
+	DOMAIN_SORTED_RUNS,
+};
+
+#if defined(__SSE2__)
+
+/*
+ * High and low words of the products of the four lanes of `x' by `m'.
+ */
+INLINE static void vmulhilo(__m128i x, __m128i m, __m128i *hi, __m128i *lo)
+{
+	const __m128i even = _mm_set_epi32(0, -1, 0, -1);
+	__m128i p02, p13;
+
+	p02 = _mm_mul_epu32(x, m);
+	p13 = _mm_mul_epu32(_mm_srli_epi64(x, 32), m);
+
+	*lo = _mm_or_si128(_mm_and_si128(p02, even), _mm_slli_epi64(p13, 32));
+	*hi = _mm_or_si128(_mm_srli_epi64(p02, 32), _mm_andnot_si128(even, p13));
+}
+
+/*
+ * Philox4x32-10 over the `len' (rounded up to 4) counters from `ctr',
+ * four counters per vector.
+ */
+static void dist_batch(u64 seed, u64 ctr, u32 len, u32 r[4][DIST_BATCH])
+{
+	const __m128i m0 = _mm_set1_epi32(PHILOX_M0);
+	const __m128i m1 = _mm_set1_epi32(PHILOX_M1);
+	__m128i c0, c1, c2, c3, k0, k1, hi0, lo0, hi1, lo1;
+	u32 i, j;
+	u64 c;
+
+	for (j=0; j<len; j+=4) {
+		c = ctr + j;
+		c0 = _mm_set_epi32(c + 3, c + 2, c + 1, c);
+		c1 = _mm_set_epi32((c + 3) >> 32, (c + 2) >> 32,
+				   (c + 1) >> 32, c >> 32);
+		c2 = _mm_setzero_si128();
+		c3 = _mm_setzero_si128();
+		k0 = _mm_set1_epi32(seed);
+		k1 = _mm_set1_epi32(seed >> 32);
+
+		for (i=0; i<PHILOX_ROUNDS; ++i) {
+			vmulhilo(c0, m0, &hi0, &lo0);
+			vmulhilo(c2, m1, &hi1, &lo1);
+
+			c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), k0);
+			c1 = lo1;
+			c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), k1);
+			c3 = lo0;
+
+			k0 = _mm_add_epi32(k0, _mm_set1_epi32(PHILOX_W0));
+			k1 = _mm_add_epi32(k1, _mm_set1_epi32(PHILOX_W1));
+		}
+
+		_mm_storeu_si128((__m128i *)(r[0] + j), c0);
+		_mm_storeu_si128((__m128i *)(r[1] + j), c1);
+		_mm_storeu_si128((__m128i *)(r[2] + j), c2);
+		_mm_storeu_si128((__m128i *)(r[3] + j), c3);
+	}
+}
+
+#else /* !__SSE2__ */
+
+/*
+ * Philox4x32-10 over `len' consecutive counters from `ctr'.
+ */
+static void dist_batch(u64 seed, u64 ctr, u32 len, u32 r[4][DIST_BATCH])
+{
+	u32 k0, k1, i, j;
+	u64 p0, p1;
+
+	for (j=0; j<len; ++j) {
+		r[0][j] = ctr + j;
+		r[1][j] = (ctr + j) >> 32;
+		r[2][j] = 0;
+		r[3][j] = 0;
+
+		k0 = seed;
+		k1 = seed >> 32;
+
+		for (i=0; i<PHILOX_ROUNDS; ++i) {
+			p0 = (u64)PHILOX_M0 * r[0][j];
+			p1 = (u64)PHILOX_M1 * r[2][j];
+
+			r[0][j] = (p1 >> 32) ^ r[1][j] ^ k0;
+			r[1][j] = p1;
+			r[2][j] = (p0 >> 32) ^ r[3][j] ^ k1;
+			r[3][j] = p0;
+
+			k0 += PHILOX_W0;
+			k1 += PHILOX_W1;
+		}
+	}
+}
+
+#endif /* __SSE2__ */
+
+void dist_random(u64 seed, u64 ctr, u32 out[4])
+{
+	u32 r[4][DIST_BATCH];
+
+	dist_batch(seed, ctr, 1, r);
+
+	out[0] = r[0][0];
+	out[1] = r[1][0];
+	out[2] = r[2][0];
+	out[3] = r[3][0];
+}
+
+/*
+ * Key of the `i'-th element of an ascending ramp of `n', over
+ * DIST_VALUE_RANGE units.
+ */
+INLINE static u64 ramp(u32 i, u32 n)
+{
+	const u64 range = DIST_VALUE_RANGE * DIST_UNIT;
+
+	/* i * range / n, with no overflow: */
+	return i * (range / n) + (u64)i * (range % n) / n;
+}
+
+/*
+ * CASE_K_SORTED: the ramp, shuffled inside aligned blocks of K_SORTED
+ * elements.
+ */
+static void fill_k_sorted(u64 *v, u32 n, u32 from, u32 to, u64 seed)
+{
+	u32 r[4][DIST_BATCH];
+	u8 perm[K_SORTED];
+	u32 b, i, k, x;
+	u8 t;
+
+	for (b=from/K_SORTED; b*(u64)K_SORTED<to; ++b) {
+		/* Fisher-Yates, a word per draw: */
+		dist_batch(seed, DOMAIN(DOMAIN_K_SORTED, b * (K_SORTED/4)),
+			   K_SORTED/4, r);
+
+		for (k=0; k<K_SORTED; ++k)
+			perm[k] = k;
+
+		for (k=K_SORTED-1; k>0; --k) {
+			x = WORD(r, k) % (k + 1);
+			t = perm[k];
+			perm[k] = perm[x];
+			perm[x] = t;
+		}
+
+		for (k=0; k<K_SORTED; ++k) {
+			i = b * K_SORTED + k;
+			x = b * K_SORTED + perm[k];
+			if (i >= from && i < to)
+				v[i] = ramp(x < n ? x : i, n);
+		}
+	}
+}
+
+/*
+ * CASE_ZIPF: P(k) ~ 1/k. `cdf' gets the cumulative distribution of the
+ * ranks scaled to 2^32, and `start' the first rank of every slice of
+ * ZIPF_SLICES words, where the search for a word begins.
+ */
+static void zipf_table(u64 *cdf, u16 *start)
+{
+	double sum, acc;
+	u32 k, b;
+
+	for (sum=0, k=0; k<DIST_VALUE_MAX; ++k)
+		sum += 1.0 / (k + 1);
+
+	for (acc=0, k=0; k<DIST_VALUE_MAX; ++k) {
+		acc += 1.0 / (k + 1);
+		cdf[k] = acc / sum * 4294967296.0;
+	}
+	cdf[DIST_VALUE_MAX-1] = (u64)1 << 32;
+
+	for (k=0, b=0; b<ZIPF_SLICES; ++b) {
+		while (cdf[k] <= ((u64)b << 32) / ZIPF_SLICES)
+			++k;
+		start[b] = k;
+	}
+}
+
+INLINE static u16 zipf_value(const u64 *cdf, const u16 *start, u32 word)
+{
+	u32 k = start[(u64)word * ZIPF_SLICES >> 32];
+
+	while (cdf[k] <= word)
+		++k;
+
+	return k;
+}
+
+void dist_fill(u64 *v, u32 n, u32 from, u32 to, SortCase kase, u64 seed)
+{
+	u32 r[4][DIST_BATCH];
+	u32 w[4], i, j, len, end, period, half, run;
+	u64 few[FEW_UNIQUE], x;
+	u64 cdf[DIST_VALUE_MAX];
+	u16 start[ZIPF_SLICES];
+
+	switch (kase) {
+	case CASE_SAWTOOTH:
+		period = (n + SAW_TEETH - 1) / SAW_TEETH;
+		for (i=from; i<to; ++i)
+			v[i] = ramp(i % period, period);
+		return;
+
+	case CASE_ORGAN_PIPE:
+		half = (n + 1) / 2;
+		for (i=from; i<to; ++i)
+			v[i] = ramp(i < half ? i : n - 1 - i, half);
+		return;
+
+	case CASE_ALL_EQUAL:
+		for (i=from; i<to; ++i)
+			v[i] = DIST_VALUE_MAX / 2 * DIST_UNIT;
+		return;
+
+	case CASE_K_SORTED:
+		fill_k_sorted(v, n, from, to, seed);
+		return;
+
+	case CASE_SORTED_RUNS:
+		run = (n + SORTED_RUNS - 1) / SORTED_RUNS;
+		for (i=from; i<to; i=end) {
+			/* every run is lifted by a random offset: */
+			dist_random(seed, DOMAIN(DOMAIN_SORTED_RUNS, i / run),
+				    w);
+			end = (i / run + 1) * run;
+			if (end > to)
+				end = to;
+			x = ((u64)w[0] << 32 | w[1]) %
+				((DIST_VALUE_MAX - DIST_VALUE_RANGE) *
+				 DIST_UNIT);
+			for (j=i; j<end; ++j)
+				v[j] = ramp(j % run, run) + x;
+		}
+		return;
+
+	case CASE_FEW_UNIQUE:
+		for (j=0; j<FEW_UNIQUE; ++j) {
+			dist_random(seed, DOMAIN(DOMAIN_FEW_UNIQUE, j), w);
+			few[j] = (u64)w[0] << 32 | w[1];
+		}
+		break;
+
+	case CASE_ZIPF:
+		zipf_table(cdf, start);
+		break;
+
+	case CASE_RANDOM:
+	case CASE_REVERSED:
+	case CASE_NEARLY_SORTED:
+		break;
+
+	default:
+		log_fixme("unknown case number: #%d", kase);
+		return;
+	}
+
+	/* the batches start on the first word of a counter: */
+	for (i=from & ~1u; i<to; i+=2*DIST_BATCH) {
+		len = (to - i + 1) / 2 < DIST_BATCH ? (to - i + 1) / 2
+			: DIST_BATCH;
+		dist_batch(seed, DOMAIN(DOMAIN_ELEMENT, i / 2), len, r);
+
+		j = i < from ? from - i : 0;
+		end = 2 * len < to - i ? 2 * len : to - i;
+
+		switch (kase) {
+		case CASE_RANDOM:
+			for (; j<end; ++j)
+				v[i+j] = WORD64(r, j);
+			break;
+
+		case CASE_REVERSED:
+			for (; j<end; ++j)
+				v[i+j] = WORD64(r, j) %
+					(REVERSED_NOISE * DIST_UNIT) +
+					ramp(n - (i+j+1), n);
+			break;
+
+		case CASE_NEARLY_SORTED:
+			for (; j<end; ++j) {
+				x = WORD64(r, j);
+				v[i+j] = x % 3 ? ramp(i+j, n) : x;
+			}
+			break;
+
+		case CASE_FEW_UNIQUE:
+			for (; j<end; ++j)
+				v[i+j] = few[WORD64(r, j) % FEW_UNIQUE];
+			break;
+
+		case CASE_ZIPF:
+			for (; j<end; ++j)
+				v[i+j] = zipf_value(cdf, start,
+						    WORD64(r, j) >> 32) *
+					DIST_UNIT;
+			break;
+
+		default:
+			break;
+		}
+	}
+}
@@ -0,0 +1,57 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DIST_H
+#define DIST_H
+
+#include "stdinc.h"
+#include "sort.h"
+
+/*
+ * Input distributions.
+ *
+ * Values are drawn from Philox4x32-10, a counter-based generator: the
+ * random words of the `i'-th element depend only on the seed and on `i',
+ * so that any slice of an input can be generated on its own and the same
+ * seed always gives the same input, however it is split among threads.
+ */
+
+/*
+ * Keys span the whole of u64, in DIST_VALUE_MAX units of DIST_UNIT: the
+ * unit a key falls in is its value on screen (in 0..DIST_VALUE_MAX-1,
+ * ramps in 0..DIST_VALUE_RANGE-1), and the key within its unit tells
+ * apart the elements of the same value.
+ */
+#define DIST_VALUE_MAX		400
+#define DIST_VALUE_RANGE	384
+#define DIST_UNIT		((u64)-1 / DIST_VALUE_MAX + 1)
+
+/* value on screen of the key X: */
+#define DIST_VALUE(X)		((u16)((X) / DIST_UNIT))
+
+/*
+ * Store in `out' the four words of the counter `ctr' of the stream `seed'.
+ */
+void dist_random (u64 seed, u64 ctr, u32 out[4]);
+
+/*
+ * Fill v[from..to) with the keys of the `n'-element input of case `kase'
+ * drawn from `seed'.
+ */
+void dist_fill (u64 *v, u32 n, u32 from, u32 to, SortCase kase, u64 seed);
+
+#endif /* !DIST_H */
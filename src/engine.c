@@ -43,16 +43,37 @@
 
 # define TEXT_ALGO_Y	372
 # define TEXT_CASE_Y	390
+# define TEXT_SPEED_Y	372
+# define TEXT_STATS_Y	390
 # define TEXT_PADDING_X	15
 # define TEXT_PADDING_Y	15
 # define TEXT_COLOR	0xdedede
 
-# define FONT_FILENAME	"DejaVuSans.ttf"
 # define FONT_PTS	18
 
 #endif /* HAVE_LIBSDL_TTF */
 
-#define IDLE_MS		20
+#define FRAME_MS	20
+
+/* sort operations replayed per millisecond at 1x (one every 500us): */
+#define REPLAY_RATE	2
+
+/* time of a frame left to replaying, the rest being for drawing it: */
+#define REPLAY_MS	(FRAME_MS * 3 / 4)
+
+/* operations replayed between two looks at the clock: */
+#define REPLAY_SLICE	1024
+
+/* longest gap followed by the virtual clock (stalls are not caught up): */
+#define MAX_LAG_MS	(4 * FRAME_MS)
+
+/* frames the shown rate is averaged over (one second): */
+#define RATE_FRAMES	(1000 / FRAME_MS)
+
+/* speed multipliers, 0 for unlimited: */
+static const u16 speeds[] = { 1, 2, 4, 8, 16, 32, 64, 128, 256, 0 };
+
+#define NSPEEDS		(sizeof(speeds) / sizeof(speeds[0]))
 
 /*
  * Engine states:
@@ -75,38 +96,43 @@ static struct {
 	bool running;
 
 	Array  *array;
+	MapFile *file;
+	u32 partial;		/* elements sorted by a session, 0 for all */
 	Menu   *menu_algo, *menu_case;
 	Dialog *exit_dialog;
 
+	/* step scheduler: */
+	u8  speed;		/* index in speeds[] */
+	u32 clock;		/* ticks the virtual clock is at */
+	u32 owed;		/* operations owed by the virtual clock */
+	u64 ops;		/* operations replayed by the session */
+	u32 frames;		/* frames of the session */
+	u32 rate_ops, rate_frames;
+	double rate;		/* operations per frame in the last second */
+
 #if HAVE_LIBSDL_TTF
-	Text   *txt_algo, *txt_case;
+	Text   *txt_algo, *txt_case, *txt_stats, *txt_speed;
+	SortStats stats;	/* shown by txt_stats */
+	u64 inserts;		/* likewise, in live mode */
 #endif
 
 	char *datadir;
 } sd;
 
-#if HAVE_LIBSDL_TTF
-
-static const char *ARRAY_STRALGO[] = {
-	"bubble sort", "selection sort", 
-	"insertion sort", "quick sort", "heap sort",
-};
-
-static const char *ARRAY_STRCASE[] = {
-	"random", "reversed",
-	"nearly sorted", "few unique",
-};
-
-#endif /* HAVE_LIBSDL_TTF */
-
 static void draw            (void);
+static void update_stats    (bool force);
+static void update_speed    (void);
+static void set_speed       (int speed);
+static u32  replay_frame    (u32 start);
+static void count_frame     (u32 ops);
 static void handle_input    (void);
 static void on_array_sorted (Array *);
 
 /*
  * Initialize sort_demo's engine.
  */
-int engine_init(int opts, const char *datadir)
+int engine_init(int opts, const char *datadir, u32 size, u64 seed,
+		MapFile *file, u32 partial)
 {
 #if HAVE_LIBSDL_TTF
 	char path[PATH_MAX];
@@ -134,8 +160,25 @@ int engine_init(int opts, const char *datadir)
 
 	sd.datadir = datadir ? strdup(datadir) : strdup(DATADIR);
 
-	sd.array = array_new();
+	sd.file = file;
+	if (file)
+		sd.array = array_new_mapped(file);
+	else
+		sd.array = array_new(size ? size : ARRAY_DEFAULT_SIZE, seed);
+
+	if (!sd.array) {
+		free(sd.datadir);
+#if HAVE_LIBSDL_TTF
+		ttf_quit();
+#endif
+		video_quit();
+		return -1;
+	}
+
 	array_set_callback(sd.array, on_array_sorted);
+	array_set_partial(sd.array, partial);
+	array_set_live(sd.array, opts & ENGINE_OPTION_LIVE);
+	sd.partial = partial;
 
  	sd.menu_algo = menu_new(MENU_TYPE_ALGO);
 	sd.menu_case = menu_new(MENU_TYPE_CASE);
@@ -147,8 +190,11 @@ int engine_init(int opts, const char *datadir)
 
 	sd.txt_algo = text_new(path, FONT_PTS, TEXT_COLOR);
 	sd.txt_case = text_new(path, FONT_PTS-2, TEXT_COLOR);
+	sd.txt_stats = text_new(path, FONT_PTS-6, TEXT_COLOR);
+	sd.txt_speed = text_new(path, FONT_PTS-6, TEXT_COLOR);
 #endif
 
+	sd.speed = 0;
 	sd.running = 0;
 	sd.state = STATE_MENU_ALGO;
 
@@ -164,7 +210,8 @@ INLINE void engine_quit(void)
 	free(sd.datadir);
 
 #if HAVE_LIBSDL_TTF
-	objects_free(sd.txt_algo, sd.txt_case, NULL);
+	objects_free(sd.txt_algo, sd.txt_case, sd.txt_stats, sd.txt_speed,
+		     NULL);
 	ttf_quit();
 #endif
 
@@ -173,10 +220,16 @@ INLINE void engine_quit(void)
 
 /*
  * sort_demo main loop.
+ * Frames are paced on the clock, FRAME_MS apart however long replaying and
+ * drawing them took, and every frame replays the operations a virtual
+ * clock running at the chosen speed owes the sort-session (see
+ * replay_frame()): the animation goes at the same pace whatever the
+ * algorithm and the speed.
  */
 int engine_loop(void)
 {
 	u16 algo, kase, w;
+	u32 next, now;
 
 	if (sd.running) {
 		log_warn("main loop is already running");
@@ -185,6 +238,7 @@ int engine_loop(void)
 
 	sd.running = 1;
 	sd.state = STATE_MENU_ALGO;
+	next = SDL_GetTicks();
 
 	do {
 		handle_input();
@@ -194,8 +248,14 @@ int engine_loop(void)
 			algo = menu_get_value(sd.menu_algo);
 			kase = menu_get_value(sd.menu_case);
 #if HAVE_LIBSDL_TTF
-			text_set_text(sd.txt_algo, "%s", ARRAY_STRALGO[algo]);
-			text_set_text(sd.txt_case, "%s", ARRAY_STRCASE[kase]);
+			if (sd.partial)
+				text_set_text(sd.txt_algo, "%s (first %u)",
+					      sort_algo_name(algo), sd.partial);
+			else
+				text_set_text(sd.txt_algo, "%s",
+					      sort_algo_name(algo));
+			text_set_text(sd.txt_case, "%s",
+				      sd.file ? "file" : sort_case_name(kase));
 
 			w = layer_get_width(sd.txt_algo);
 			layer_set_xy(sd.txt_algo,
@@ -209,11 +269,34 @@ int engine_loop(void)
 #endif /* HAVE_LIBSDL_TTF */
 
 			sd.state = STATE_EXEC_RUNNING;
+			sd.clock = SDL_GetTicks();
+			sd.owed = sd.ops = sd.frames = 0;
+			sd.rate_ops = sd.rate_frames = 0;
+			sd.rate = 0;
 			array_sort(sd.array, algo, kase);
+			update_stats(1);
+			update_speed();
+		}
+
+		if (sd.state == STATE_EXEC_RUNNING) {
+			count_frame(replay_frame(next));
+			update_stats(0);
+
+			if (sd.state == STATE_EXEC_FINISHED && sd.ops)
+				log_info("%llu operations replayed in %u "
+					 "frames (%.1f per frame)",
+					 (unsigned long long)sd.ops, sd.frames,
+					 (double)sd.ops / sd.frames);
 		}
 
 		draw();
-		SDL_Delay(IDLE_MS);
+
+		next += FRAME_MS;
+		now = SDL_GetTicks();
+		if ((s32)(next - now) > 0)
+			SDL_Delay(next - now);
+		else
+			next = now;	/* late: the next frame starts now */
 	} while (sd.running);
     
 	return 0;
@@ -257,6 +340,157 @@ char *join_path(const char *a, const char *b, char *buf)
 	return retp;
 }
 
+/*
+ * Show the counters of the running sort-session, rendering them again
+ * only when they changed (or if `force').
+ */
+static void update_stats(bool force)
+{
+#if HAVE_LIBSDL_TTF
+	SortStats stats;
+	LiveStats live;
+
+	if (array_get_live_stats(sd.array, &live) == 0) {
+		if (!force && live.inserts == sd.inserts)
+			return;
+
+		sd.inserts = live.inserts;
+		text_set_text(sd.txt_stats, "inserts %llu  %.0f/s  p99 %llu ns  "
+			      "batches %llu", (unsigned long long)live.inserts,
+			      live.ns ? live.inserts * 1e9 / live.ns : 0.0,
+			      (unsigned long long)live.p99_ns,
+			      (unsigned long long)live.batches);
+		layer_set_xy(sd.txt_stats, TEXT_PADDING_X,
+			     TEXT_STATS_Y - TEXT_PADDING_Y);
+		return;
+	}
+
+	array_get_stats(sd.array, &stats);
+	if (!force && !memcmp(&stats, &sd.stats, sizeof(stats)))
+		return;
+
+	sd.stats = stats;
+	text_set_text(sd.txt_stats, "cmps %llu  reads %llu  swaps %llu  "
+		      "moves %llu", (unsigned long long)stats.cmps,
+		      (unsigned long long)stats.reads,
+		      (unsigned long long)stats.swaps,
+		      (unsigned long long)stats.moves);
+	layer_set_xy(sd.txt_stats, TEXT_PADDING_X,
+		     TEXT_STATS_Y - TEXT_PADDING_Y);
+#endif
+}
+
+/*
+ * Show the speed and the operations replayed per frame.
+ */
+static void update_speed(void)
+{
+#if HAVE_LIBSDL_TTF
+	char speed[16];
+
+	if (speeds[sd.speed])
+		sprintf(speed, "%ux", speeds[sd.speed]);
+	else
+		strcpy(speed, "unlimited");
+
+	if (sd.rate)
+		text_set_text(sd.txt_speed, "speed %s  %.0f ops/frame",
+			      speed, sd.rate);
+	else
+		text_set_text(sd.txt_speed, "speed %s", speed);
+
+	layer_set_xy(sd.txt_speed, TEXT_PADDING_X,
+		     TEXT_SPEED_Y - TEXT_PADDING_Y);
+#endif
+}
+
+/*
+ * Set the speed to speeds[`speed'] (clamped to the table).
+ */
+static void set_speed(int speed)
+{
+	if (speed < 0)
+		speed = 0;
+	else if (speed >= (int)NSPEEDS)
+		speed = NSPEEDS - 1;
+
+	if (speed == sd.speed)
+		return;
+
+	sd.speed = speed;
+	sd.rate_ops = sd.rate_frames = 0;
+	sd.rate = 0;
+	update_speed();
+}
+
+/*
+ * Replay the operations the virtual clock owes the running sort-session
+ * since the last frame, and return how many were replayed. The clock runs
+ * REPLAY_RATE operations per millisecond times the speed; at unlimited
+ * speed it owes as many as can be replayed within REPLAY_MS of `start',
+ * the ticks the frame started at, which also bounds the other speeds.
+ * What is not replayed, because of that bound or because the sort has not
+ * produced it yet, is owed to the next frames, up to MAX_LAG_MS.
+ */
+static u32 replay_frame(u32 start)
+{
+	u32 now, dt, max, budget, slice, count, total;
+	u16 mult;
+
+	now = SDL_GetTicks();
+	dt = now - sd.clock;
+	if (dt > MAX_LAG_MS)
+		dt = MAX_LAG_MS;
+	sd.clock = now;
+
+	mult = speeds[sd.speed];
+	if (mult) {
+		max = MAX_LAG_MS * REPLAY_RATE * mult;
+		sd.owed += dt * REPLAY_RATE * mult;
+		if (sd.owed > max)
+			sd.owed = max;
+		budget = sd.owed;
+	}
+	else {
+		budget = UINT_MAX;
+	}
+
+	total = 0;
+	while (budget) {
+		slice = budget < REPLAY_SLICE ? budget : REPLAY_SLICE;
+		count = array_replay(sd.array, slice);
+
+		total += count;
+		budget -= count;
+		if (mult)
+			sd.owed -= count;
+
+		/* the sort has not produced more yet: */
+		if (count < slice || SDL_GetTicks() - start >= REPLAY_MS)
+			break;
+	}
+
+	return total;
+}
+
+/*
+ * Account the `ops' operations replayed by a frame of the sort-session,
+ * showing their average over the last RATE_FRAMES frames.
+ */
+static void count_frame(u32 ops)
+{
+	sd.ops += ops;
+	++sd.frames;
+
+	sd.rate_ops += ops;
+	if (++sd.rate_frames < RATE_FRAMES)
+		return;
+
+	sd.rate = (double)sd.rate_ops / sd.rate_frames;
+	sd.rate_ops = sd.rate_frames = 0;
+	update_speed();
+}
+
 /*
  * Performs sprites blit then update display.
  */
@@ -275,7 +509,8 @@ static void draw(void)
 
 		default:
 #if HAVE_LIBSDL_TTF			
-			objects_blit(sd.array, sd.txt_algo, sd.txt_case, NULL);
+			objects_blit(sd.array, sd.txt_algo, sd.txt_case,
+				     sd.txt_stats, sd.txt_speed, NULL);
 #else
 			object_blit(sd.array);
 #endif
@@ -294,7 +529,8 @@ static void draw(void)
 		
 	default:
 #if HAVE_LIBSDL_TTF			
-			objects_blit(sd.array, sd.txt_algo, sd.txt_case, NULL);
+			objects_blit(sd.array, sd.txt_algo, sd.txt_case,
+				     sd.txt_stats, sd.txt_speed, NULL);
 #else
 			object_blit(sd.array);
 #endif
@@ -476,6 +712,25 @@ static void handle_input(void)
 				}
 				break;
 
+			case SDLK_PLUS:
+			case SDLK_EQUALS:
+			case SDLK_KP_PLUS:
+				set_speed(sd.speed + 1);
+				break;
+
+			case SDLK_MINUS:
+			case SDLK_KP_MINUS:
+				set_speed(sd.speed - 1);
+				break;
+
+			case SDLK_1:
+				set_speed(0);
+				break;
+
+			case SDLK_0:
+				set_speed(NSPEEDS - 1);
+				break;
+
 			case SDLK_f:
 				video_toggle_fullscreen();
 				break;
@@ -539,4 +794,5 @@ static void handle_input(void)
 INLINE static void on_array_sorted(Array *ignored)
 {
 	sd.state = STATE_EXEC_FINISHED;
+	update_stats(0);
 }
@@ -18,8 +18,12 @@
 #ifndef ENGINE_H
 #define ENGINE_H
 
+#include "stdinc.h"
+#include "mapfile.h"
+
 enum EngineOptions {
 	ENGINE_OPTION_FS=	1 << 0,
+	ENGINE_OPTION_LIVE=	1 << 1,	/* see array_set_live() */
 };
 
 /*
@@ -28,10 +32,17 @@ enum EngineOptions {
  * `opts' should be or-ed EngineOptions or 0.
  *  If `datadir' is a NULL pointer, default directory will be used (whose was
  *  definited at compilation time).
+ *  `size' is the number of elements to sort (0 for the default size).
+ *  `seed' is the seed of the inputs.
+ *  If `file' is not a NULL pointer, its elements are sorted instead of the
+ *  generated inputs (see array_new_mapped()).
+ *  If `partial' is not 0, only the `partial' smallest elements are sorted
+ *  (see array_set_partial()).
  *  engine_init() will return 0 if the engine was initialized correctly;
  *  otherwise, on error, the functino will return -1.
  */
-int  engine_init  (int opts, const char *datadir);
+int  engine_init  (int opts, const char *datadir, u32 size, u64 seed,
+		   MapFile *file, u32 partial);
 
 /*
  * Quit sort_demo's engine.
@@ -47,6 +58,11 @@ int  engine_loop  (void);
  /* utilities: */
  /**************/
 
+/*
+ * Font shipped in the datadir (used when SDL_ttf is available).
+ */
+#define FONT_FILENAME	"DejaVuSans.ttf"
+
 /*
  * Return the engine datadir.
  */
@@ -0,0 +1,524 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "log.h"
+#include "extsort.h"
+
+/* smallest I/O buffer of a merge source: */
+#define EXTSORT_MIN_BUFFER	(64 << 10)
+
+/*
+ * Sorted run of `bytes' bytes from `off' in a spill file.
+ */
+typedef struct {
+	u64 off;
+	u64 bytes;
+} Run;
+
+/*
+ * A run being merged: its elements are read in buffers of `cap' bytes.
+ */
+typedef struct {
+	FILE *f;
+	u64 off;		/* of the next read */
+	u8 *buf;
+	size_t cap;
+	size_t len;		/* bytes in buf */
+	size_t pos;		/* bytes of buf already merged */
+	u64 left;		/* bytes of the run still in the file */
+	u64 key;		/* key of buf[pos] */
+	bool done;
+} Source;
+
+typedef struct {
+	FILE *f;
+	u8 *buf;
+	size_t cap;
+	size_t len;
+} Sink;
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Create a temporary file, already unlinked.
+ */
+static FILE *temp_file(void)
+{
+	char path[PATH_MAX];
+	const char *dir;
+	FILE *f;
+	int fd;
+
+	dir = getenv("TMPDIR");
+	if (!dir || !*dir)
+		dir = "/tmp";
+
+	snprintf(path, sizeof(path), "%s/sort_demo.XXXXXX", dir);
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		log_err("extsort: could not create a file in %s: %s", dir,
+			strerror(errno));
+		return NULL;
+	}
+
+	unlink(path);
+
+	f = fdopen(fd, "w+b");
+	if (!f) {
+		log_err("extsort: fdopen: %s", strerror(errno));
+		close(fd);
+	}
+
+	return f;
+}
+
+static int write_bytes(FILE *f, const void *buf, size_t len,
+		       ExtsortStats *stats)
+{
+	if (len && fwrite(buf, 1, len, f) != len) {
+		log_err("extsort: write error: %s", strerror(errno));
+		return -1;
+	}
+
+	stats->bytes_written += len;
+
+	return 0;
+}
+
+static int read_bytes(FILE *f, void *buf, size_t len, ExtsortStats *stats)
+{
+	if (len && fread(buf, 1, len, f) != len) {
+		log_err("extsort: %s", ferror(f) ? strerror(errno)
+						   : "unexpected end of file");
+		return -1;
+	}
+
+	stats->bytes_read += len;
+
+	return 0;
+}
+
+/*
+ * Load the next element of `src' (refilling its buffer when it is over)
+ * and its key.
+ */
+static int source_next(Source *src, SortElem elem, ExtsortStats *stats)
+{
+	if (src->pos == src->len) {
+		if (!src->left) {
+			src->done = 1;
+			return 0;
+		}
+
+		src->len = src->left < src->cap ? src->left : src->cap;
+		src->pos = 0;
+		src->left -= src->len;
+
+		if (fseeko(src->f, src->off, SEEK_SET) != 0) {
+			log_err("extsort: seek error: %s", strerror(errno));
+			return -1;
+		}
+
+		if (read_bytes(src->f, src->buf, src->len, stats) != 0)
+			return -1;
+
+		src->off += src->len;
+	}
+
+	src->key = sort_elem_key(src->buf + src->pos, 0, elem);
+
+	return 0;
+}
+
+/*
+ * Return 1 if the current element of src[a] goes out before the one of
+ * src[b]: ties go to the earlier run, so that the merge is stable.
+ */
+INLINE static bool beats(const Source *src, u32 a, u32 b)
+{
+	if (src[a].done)
+		return 0;
+
+	if (src[b].done)
+		return 1;
+
+	return src[a].key < src[b].key ||
+		(src[a].key == src[b].key && a < b);
+}
+
+/*
+ * Build the loser tree of the `k' sources: node j (1 <= j < k) keeps the
+ * loser of the match between its children 2j and 2j+1, node k+i being
+ * src[i]. Return the winner of the subtree `j'.
+ */
+static u32 tree_build(u32 *tree, const Source *src, u32 k, u32 j)
+{
+	u32 a, b;
+
+	if (j >= k)
+		return j - k;
+
+	a = tree_build(tree, src, k, 2*j);
+	b = tree_build(tree, src, k, 2*j + 1);
+
+	if (beats(src, a, b)) {
+		tree[j] = b;
+		return a;
+	}
+
+	tree[j] = a;
+	return b;
+}
+
+static int sink_flush(Sink *out, ExtsortStats *stats)
+{
+	if (write_bytes(out->f, out->buf, out->len, stats) != 0)
+		return -1;
+
+	out->len = 0;
+
+	return 0;
+}
+
+/*
+ * Merge the `k' runs of `in' into `f', with about `mem' bytes of buffers.
+ */
+static int merge_runs(FILE *in, const Run *runs, u32 k, FILE *f,
+		      SortElem elem, size_t mem, ExtsortStats *stats)
+{
+	Source *src;
+	Sink out;
+	u32 *tree, i, j, w, t;
+	size_t size, cap;
+	int retv = -1;
+
+	size = sort_elem_size(elem);
+
+	cap = mem / (k + 1);
+	if (cap < EXTSORT_MIN_BUFFER)
+		cap = EXTSORT_MIN_BUFFER;
+	cap -= cap % size;
+
+	src = calloc(k, sizeof(*src));
+	tree = malloc(k * sizeof(*tree));
+	out.f = f;
+	out.buf = malloc(cap);
+	out.cap = cap;
+	out.len = 0;
+
+	if (!src || !tree || !out.buf) {
+		log_err("extsort: could not allocate the merge buffers");
+		goto out;
+	}
+
+	for (i=0; i<k; ++i) {
+		src[i].f = in;
+		src[i].off = runs[i].off;
+		src[i].cap = cap;
+		src[i].left = runs[i].bytes;
+		src[i].buf = malloc(cap);
+
+		if (!src[i].buf) {
+			log_err("extsort: could not allocate the merge "
+				"buffers");
+			goto out;
+		}
+
+		if (source_next(&src[i], elem, stats) != 0)
+			goto out;
+	}
+
+	tree[0] = tree_build(tree, src, k, 1);
+
+	for (;;) {
+		w = tree[0];
+		if (src[w].done)
+			break;
+
+		memcpy(out.buf + out.len, src[w].buf + src[w].pos, size);
+		out.len += size;
+		if (out.len == out.cap && sink_flush(&out, stats) != 0)
+			goto out;
+
+		src[w].pos += size;
+		if (source_next(&src[w], elem, stats) != 0)
+			goto out;
+
+		/* replay the matches from the leaf of the winner up: */
+		for (j=(w + k)/2; j>0; j/=2) {
+			if (beats(src, tree[j], w)) {
+				t = tree[j];
+				tree[j] = w;
+				w = t;
+			}
+		}
+
+		tree[0] = w;
+	}
+
+	if (sink_flush(&out, stats) != 0 || fflush(f) != 0)
+		goto out;
+
+	retv = 0;
+
+out:
+	if (src)
+		for (i=0; i<k; ++i)
+			free(src[i].buf);
+
+	free(src);
+	free(tree);
+	free(out.buf);
+
+	return retv;
+}
+
+/*
+ * Merge the runs of `*spill' EXTSORT_MAX_WAYS at a time into new runs until
+ * they are few enough for the last pass: every pass writes its runs to
+ * `*other' and the two files trade places.
+ */
+static int merge_passes(FILE **spill, FILE **other, Run *runs, u32 *nruns,
+			SortElem elem, size_t mem, ExtsortStats *stats)
+{
+	u32 i, j, k, n;
+	FILE *f;
+	Run run;
+
+	while (*nruns > EXTSORT_MAX_WAYS) {
+		if (!*other) {
+			*other = temp_file();
+			if (!*other)
+				return -1;
+		}
+
+		rewind(*other);
+		run.off = 0;
+		n = 0;
+
+		for (i=0; i<*nruns; i+=k) {
+			k = *nruns - i;
+			if (k > EXTSORT_MAX_WAYS)
+				k = EXTSORT_MAX_WAYS;
+
+			if (merge_runs(*spill, runs + i, k, *other, elem, mem,
+				       stats) != 0)
+				return -1;
+
+			run.bytes = 0;
+			for (j=i; j<i+k; ++j)
+				run.bytes += runs[j].bytes;
+
+			runs[n++] = run;
+			run.off += run.bytes;
+		}
+
+		f = *spill;
+		*spill = *other;
+		*other = f;
+
+		*nruns = n;
+		++stats->passes;
+	}
+
+	return 0;
+}
+
+int extsort_run(const char *input, const char *output, SortElem elem,
+		SortType algo, size_t chunk, ExtsortStats *stats)
+{
+	ExtsortStats st;
+	struct stat sb;
+	FILE *in, *out, *spill, *other;
+	Run *runs;
+	u8 *buf;
+	u64 total, left;
+	size_t size, len;
+	u32 nruns;
+	u64 t0;
+	int retv = -1;
+
+	memset(&st, 0, sizeof(st));
+
+	size = sort_elem_size(elem);
+	if (!size) {
+		log_fixme("unknown element type: #%d", elem);
+		return -1;
+	}
+
+	/* whole elements, no more than a sort run can take: */
+	if (chunk / size > INT_MAX)
+		chunk = (size_t)INT_MAX * size;
+
+	chunk -= chunk % size;
+	if (!chunk)
+		chunk = size;
+
+	in = fopen(input, "rb");
+	if (!in) {
+		log_err("extsort: could not open %s: %s", input,
+			strerror(errno));
+		return -1;
+	}
+
+	if (fstat(fileno(in), &sb) != 0) {
+		log_err("extsort: %s: %s", input, strerror(errno));
+		fclose(in);
+		return -1;
+	}
+
+	total = sb.st_size;
+	if (total % size) {
+		log_err("extsort: the size of %s is not a multiple of %lu "
+			"bytes", input, (unsigned long)size);
+		fclose(in);
+		return -1;
+	}
+
+	st.n = total / size;
+
+	if (total < chunk)
+		chunk = total ? total : size;
+
+	buf = malloc(chunk);
+	runs = calloc(total / chunk + 1, sizeof(*runs));
+	out = NULL;
+	spill = NULL;
+	other = NULL;
+	nruns = 0;
+
+	if (!buf || !runs) {
+		log_err("extsort: could not allocate %lu bytes",
+			(unsigned long)chunk);
+		goto out;
+	}
+
+	/* run generation: */
+	t0 = now_ns();
+
+	for (left=total; left; left-=len) {
+		len = left < chunk ? left : chunk;
+
+		if (read_bytes(in, buf, len, &st) != 0)
+			goto out;
+
+		sort_run_elems(buf, len / size, elem, algo, NULL);
+
+		/* a single run goes straight to the output: */
+		if (len == total)
+			break;
+
+		if (!spill) {
+			spill = temp_file();
+			if (!spill)
+				goto out;
+		}
+
+		runs[nruns].off = total - left;
+		runs[nruns++].bytes = len;
+
+		if (write_bytes(spill, buf, len, &st) != 0)
+			goto out;
+	}
+
+	if (spill && fflush(spill) != 0) {
+		log_err("extsort: write error: %s", strerror(errno));
+		goto out;
+	}
+
+	fclose(in);
+	in = NULL;
+
+	st.runs = nruns ? nruns : 1;
+	st.run_ns = now_ns() - t0;
+
+	/* merge, the chunk buffer giving way to the merge buffers: */
+	t0 = now_ns();
+
+	if (nruns) {
+		free(buf);
+		buf = NULL;
+	}
+
+	if (merge_passes(&spill, &other, runs, &nruns, elem, chunk,
+			 &st) != 0)
+		goto out;
+
+	out = fopen(output, "wb");
+	if (!out) {
+		log_err("extsort: could not open %s: %s", output,
+			strerror(errno));
+		goto out;
+	}
+
+	if (nruns) {
+		if (merge_runs(spill, runs, nruns, out, elem, chunk,
+			       &st) != 0)
+			goto out;
+
+		++st.passes;
+	}
+	else if (write_bytes(out, buf, total, &st) != 0) {
+		goto out;
+	}
+
+	if (fclose(out) != 0) {
+		out = NULL;
+		log_err("extsort: %s: %s", output, strerror(errno));
+		goto out;
+	}
+
+	out = NULL;
+	st.merge_ns = now_ns() - t0;
+	retv = 0;
+
+	if (stats)
+		*stats = st;
+
+out:
+	if (in)
+		fclose(in);
+
+	if (out)
+		fclose(out);
+
+	if (spill)
+		fclose(spill);
+
+	if (other)
+		fclose(other);
+
+	free(runs);
+	free(buf);
+
+	return retv;
+}
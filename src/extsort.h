@@ -0,0 +1,57 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef EXTSORT_H
+#define EXTSORT_H
+
+#include "stdinc.h"
+#include "sort.h"
+
+/*
+ * External sort of binary key files bigger than memory.
+ *
+ * The input is read in chunks, every chunk is sorted in memory and
+ * spilled to a temporary file as a sorted run, then the runs are merged
+ * through a loser tree, EXTSORT_MAX_WAYS at a time, into the output.
+ * Temporary files are created in $TMPDIR (default: /tmp) and removed
+ * right away, so that nothing is left behind.
+ */
+
+#define EXTSORT_DEFAULT_CHUNK	(64 << 20)
+#define EXTSORT_MAX_WAYS	256
+
+typedef struct {
+	u64 n;			/* elements sorted */
+	u32 runs;		/* sorted runs spilled */
+	u32 passes;		/* merge passes, the last one included */
+	u64 run_ns;		/* to read, sort and spill the runs */
+	u64 merge_ns;		/* to merge them into the output */
+	u64 bytes_read;		/* by both phases */
+	u64 bytes_written;	/* by both phases, the output included */
+} ExtsortStats;
+
+/*
+ * Sort the elements of type `elem' of the file `input' into the file
+ * `output' (which may be the same file), sorting chunks of `chunk' bytes
+ * in memory with `algo'. The merge phase uses about the same amount of
+ * memory for its buffers.
+ * Return 0 and fill `stats' (if not NULL), or -1 on error.
+ */
+int extsort_run (const char *input, const char *output, SortElem elem,
+		 SortType algo, size_t chunk, ExtsortStats *stats);
+
+#endif /* !EXTSORT_H */
@@ -0,0 +1,171 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <time.h>
+
+#include "log.h"
+#include "live.h"
+
+/* smallest batch, whatever the size of the array: */
+#define LIVE_BATCH_MIN	8
+
+struct _Live {
+	void *v;		/* the sorted array */
+	void *batch;		/* the pending values */
+	u32 *lat;		/* latency of every insert, in ns */
+	size_t elem_size;
+	SortElem elem;
+	SortType algo;
+	u32 capacity;
+	u32 n;			/* elements of the array */
+	u32 pending;		/* elements of the batch */
+	u32 batch_size;		/* elements of a full batch */
+	u32 batch_max;		/* room of `batch' */
+	LiveStats stats;	/* but the percentile */
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+Live *live_new(u32 capacity, SortElem elem, SortType algo)
+{
+	Live *self;
+
+	if (!sort_elem_size(elem) || !sort_algo_name(algo)) {
+		log_fixme("live: unknown element type #%d or algo #%d",
+			  elem, algo);
+		return NULL;
+	}
+
+	self = calloc(1, sizeof(Live));
+	if (!self)
+		return NULL;
+
+	self->elem = elem;
+	self->algo = algo;
+	self->elem_size = sort_elem_size(elem);
+	self->capacity = capacity;
+
+	/* the batches stop growing at the square root of the capacity: */
+	for (self->batch_max=LIVE_BATCH_MIN;
+	     (u64)self->batch_max * self->batch_max < capacity;
+	     ++self->batch_max)
+		;
+
+	self->v = malloc((size_t)capacity * self->elem_size);
+	self->batch = malloc((size_t)self->batch_max * self->elem_size);
+	self->lat = malloc((size_t)capacity * sizeof(u32));
+	if (!self->v || !self->batch || !self->lat) {
+		log_err("live: could not allocate %u elements", capacity);
+		live_free(self);
+		return NULL;
+	}
+
+	live_clear(self);
+
+	return self;
+}
+
+void live_free(Live *self)
+{
+	if (!self)
+		return;
+
+	free(self->v);
+	free(self->batch);
+	free(self->lat);
+	free(self);
+}
+
+void live_clear(Live *self)
+{
+	self->n = 0;
+	self->pending = 0;
+	self->batch_size = LIVE_BATCH_MIN;
+	memset(&self->stats, 0, sizeof(self->stats));
+}
+
+void live_flush(Live *self)
+{
+	if (!self->pending)
+		return;
+
+	sort_run_elems(self->batch, self->pending, self->elem, self->algo,
+		       NULL);
+	self->stats.moves += sort_merge(self->v, self->n, self->batch,
+					self->pending, self->elem, NULL);
+	self->n += self->pending;
+	self->pending = 0;
+	++self->stats.batches;
+
+	while (self->batch_size < self->batch_max &&
+	       (u64)self->batch_size * self->batch_size < self->n)
+		++self->batch_size;
+}
+
+int live_insert(Live *self, const void *x)
+{
+	u64 t0, ns;
+
+	if (self->n + self->pending >= self->capacity)
+		return -1;
+
+	t0 = now_ns();
+
+	memcpy((char *)self->batch + self->pending * self->elem_size, x,
+	       self->elem_size);
+	if (++self->pending == self->batch_size)
+		live_flush(self);
+
+	ns = now_ns() - t0;
+	self->lat[self->stats.inserts++] = ns < ~0u ? ns : ~0u;
+	self->stats.ns += ns;
+
+	return 0;
+}
+
+INLINE const void *live_get_data(const Live *self)
+{
+	return self->v;
+}
+
+INLINE u32 live_get_size(const Live *self)
+{
+	return self->n;
+}
+
+void live_get_stats(Live *self, LiveStats *stats)
+{
+	u32 n = self->stats.inserts, k;
+
+	*stats = self->stats;
+	stats->p99_ns = 0;
+
+	if (!n)
+		return;
+
+	/* the order of the latencies does not matter: */
+	k = ((u64)n * 99 + 99) / 100 - 1;
+	sort_select(self->lat, n, ELEM_U32, k, NULL);
+	stats->p99_ns = self->lat[k];
+}
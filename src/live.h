@@ -0,0 +1,84 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIVE_H
+#define LIVE_H
+
+#include "stdinc.h"
+#include "sort.h"
+
+/*
+ * Sorted container for values arriving one at a time: a sorted array and
+ * a batch of pending values. A full batch is sorted on its own and merged
+ * into the array from the back, so that an insert costs a store most of
+ * the time and the array is never sorted again from scratch.
+ * Batches hold about sqrt(n) values, n being the size of the array, which
+ * keeps the cost of the merges per insert around sqrt(n) moves.
+ * Every insert is timed, for live_get_stats().
+ */
+
+typedef struct _Live Live;
+
+/*
+ * Counters of a Live since it was created or cleared.
+ */
+typedef struct {
+	u64 inserts;
+	u64 batches;		/* merged into the array */
+	u64 moves;		/* elements of the array moved by the merges */
+	u64 ns;			/* spent in live_insert() */
+	u64 p99_ns;		/* 99th percentile of the insert latency */
+} LiveStats;
+
+/*
+ * Live ctor: up to `capacity' elements of type `elem', the batches being
+ * sorted by `algo'.
+ * On error a NULL pointer is returned.
+ */
+Live *live_new  (u32 capacity, SortElem elem, SortType algo);
+void  live_free (Live *self);
+
+/*
+ * Empty the container and reset its counters.
+ */
+void live_clear (Live *self);
+
+/*
+ * Insert the element `x' of the type of the container. Return 0, or -1 if
+ * it is full.
+ */
+int live_insert (Live *self, const void *x);
+
+/*
+ * Merge the pending batch into the array right away.
+ */
+void live_flush (Live *self);
+
+/*
+ * The sorted array: every element inserted but the pending batch, in
+ * order. It is valid until the next insert.
+ */
+const void *live_get_data (const Live *self);
+u32         live_get_size (const Live *self);
+
+/*
+ * Store the counters in `stats': the percentile is computed over every
+ * insert so far, in linear time.
+ */
+void live_get_stats (Live *self, LiveStats *stats);
+
+#endif /* !LIVE_H */
@@ -16,10 +16,17 @@
  */
 
 #include <stdio.h>
+#include <errno.h>
 #include <getopt.h>
+#include <limits.h>
+#include <time.h>
 
 #include "log.h"
 #include "engine.h"
+#include "array.h"
+#include "bench.h"
+#include "extsort.h"
+#include "mapfile.h"
 
 #define USAGE_FMT	\
 	"Sort Demo (%s)\n\n"						\
@@ -28,11 +35,52 @@
 	"  -d, --datadir=DIR\t load game data from DIR\n"		\
 	"                   \t (default: %s)\n\n"			\
 	"  --display=DISPLAY\t X display to use\n"			\
+	"  --size=N\t\t number of elements to sort\n"			\
+	"                   \t (default: %d)\n"			\
+	"  --seed=N\t\t seed of the inputs\n"				\
+	"                   \t (default: the time, or 1 with --bench)\n"	\
+	"  --threads=N\t\t number of threads of the parallel sorts\n"	\
+	"                   \t (default: number of processors)\n"	\
+	"  --bench[=FORMAT]\t run the headless benchmark and exit\n"	\
+	"                   \t (FORMAT: csv or json, default: csv)\n"	\
+	"  --type=TYPE\t\t element type of --bench and --external: u16,\n"	\
+	"                   \t u32, u64, float, double or record (default: u16)\n"	\
+	"  --external=FILE\t sort the binary keys of FILE, which may be\n"	\
+	"                   \t bigger than memory, and exit\n"	\
+	"  --output=FILE\t\t output of --external (default: FILE)\n"	\
+	"  --chunk=BYTES[K|M|G]\t memory of --external (default: 64M)\n"	\
+	"  --algo=NAME\t\t algorithm of --external, e.g. `merge-sort'\n"	\
+	"                   \t (default: intro-sort)\n"		\
+	"  --input=FILE\t\t sort the binary keys of FILE in memory with\n"	\
+	"                   \t --algo, mapping it with no copy, and exit\n"	\
+	"  --in-place\t\t write the sorted keys back to FILE\n"	\
+	"  --view\t\t show FILE in the visual mode instead\n"	\
+	"  --stable\t\t keep equal records in their order, running\n"	\
+	"                   \t unstable algorithms on (key, index) pairs\n"	\
+	"  --partial=K\t\t sort only the K smallest elements in the\n"	\
+	"                   \t visual mode\n"				\
+	"  --live\t\t insert the inputs value after value into a\n"	\
+	"                   \t sorted container in the visual mode\n"	\
 	"  --help\t\t display this help and exit\n\n"
 
 enum {
 	OPT_DISPLAY,
 	OPT_HELP,
+	OPT_BENCH,
+	OPT_SIZE,
+	OPT_THREADS,
+	OPT_TYPE,
+	OPT_SEED,
+	OPT_EXTERNAL,
+	OPT_OUTPUT,
+	OPT_CHUNK,
+	OPT_ALGO,
+	OPT_INPUT,
+	OPT_IN_PLACE,
+	OPT_VIEW,
+	OPT_STABLE,
+	OPT_PARTIAL,
+	OPT_LIVE,
 };
 
 static struct option long_options[] = {
@@ -40,17 +88,168 @@ static struct option long_options[] = {
 	{ "datadir", required_argument, NULL, 'd' },
 	{ "display", required_argument, NULL, OPT_DISPLAY },
 	{ "help", no_argument, NULL, OPT_HELP },
+	{ "bench", optional_argument, NULL, OPT_BENCH },
+	{ "size", required_argument, NULL, OPT_SIZE },
+	{ "threads", required_argument, NULL, OPT_THREADS },
+	{ "type", required_argument, NULL, OPT_TYPE },
+	{ "seed", required_argument, NULL, OPT_SEED },
+	{ "external", required_argument, NULL, OPT_EXTERNAL },
+	{ "output", required_argument, NULL, OPT_OUTPUT },
+	{ "chunk", required_argument, NULL, OPT_CHUNK },
+	{ "algo", required_argument, NULL, OPT_ALGO },
+	{ "input", required_argument, NULL, OPT_INPUT },
+	{ "in-place", no_argument, NULL, OPT_IN_PLACE },
+	{ "view", no_argument, NULL, OPT_VIEW },
+	{ "stable", no_argument, NULL, OPT_STABLE },
+	{ "partial", required_argument, NULL, OPT_PARTIAL },
+	{ "live", no_argument, NULL, OPT_LIVE },
 	{ NULL },
 };
 
+/*
+ * Match `name' against the algorithm names, dashes standing for spaces.
+ */
+static int parse_algo(const char *name)
+{
+	const char *a, *b;
+	int algo;
+
+	for (algo=0; algo<SORT_TYPE_COUNT; ++algo) {
+		a = name;
+		b = sort_algo_name(algo);
+
+		while (*a && (*a == *b || (*a == '-' && *b == ' '))) {
+			++a;
+			++b;
+		}
+
+		if (!*a && !*b)
+			return algo;
+	}
+
+	return -1;
+}
+
+/*
+ * Parse a size in bytes, with an optional K, M or G suffix.
+ */
+static int parse_bytes(const char *s, size_t *bytes)
+{
+	unsigned long long n;
+	char *end;
+	int shift;
+
+	errno = 0;
+	n = strtoull(s, &end, 10);
+	if (errno || end == s)
+		return -1;
+
+	switch (*end) {
+	case 'K': shift = 10; ++end; break;
+	case 'M': shift = 20; ++end; break;
+	case 'G': shift = 30; ++end; break;
+	default:  shift = 0;
+	}
+
+	if (*end || !n || n > (SIZE_MAX >> shift))
+		return -1;
+
+	*bytes = n << shift;
+
+	return 0;
+}
+
+static int run_external(const char *input, const char *output,
+			SortElem elem, SortType algo, size_t chunk)
+{
+	ExtsortStats st;
+
+	if (extsort_run(input, output, elem, algo, chunk, &st) != 0)
+		return 1;
+
+	printf("%s: %llu %s elements, %u runs, %u merge passes\n",
+	       output, (unsigned long long)st.n, sort_elem_name(elem),
+	       st.runs, st.passes);
+	printf("run generation: %.3f ms, merge: %.3f ms\n",
+	       st.run_ns / 1e6, st.merge_ns / 1e6);
+	printf("read: %llu bytes, written: %llu bytes\n",
+	       (unsigned long long)st.bytes_read,
+	       (unsigned long long)st.bytes_written);
+
+	return 0;
+}
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int run_input(MapFile *file, const char *input, SortType algo)
+{
+	void *data;
+	SortElem elem;
+	u32 n;
+	u64 t0, ns;
+
+	data = mapfile_get_data(file);
+	elem = mapfile_get_elem(file);
+	n = mapfile_get_size(file);
+
+	mapfile_advise(file, algo);
+
+	t0 = now_ns();
+	sort_run_elems(data, n, elem, algo, NULL);
+	ns = now_ns() - t0;
+
+	if (!sort_elems_sorted(data, n, elem)) {
+		log_err("%s: %s did not sort the input", input,
+			sort_algo_name(algo));
+		return 1;
+	}
+
+	if (mapfile_sync(file) != 0)
+		return 1;
+
+	printf("%s: %u %s elements sorted by %s in %.3f ms\n", input, n,
+	       sort_elem_name(elem), sort_algo_name(algo), ns / 1e6);
+
+	return 0;
+}
+
 int main(int ac, char *av[])
 {
-	int c;
-	char *datadir;
+	int c, bench, retv;
+	char *datadir, *end, *external, *output, *input;
+	MapFile *file;
+	unsigned long size, threads, partial;
+	unsigned long long seed;
+	bool has_seed;
+	SortElem elem;
+	int algo, mapflags;
+	size_t chunk;
+	bool view;
 	u8 opts;
 
 	datadir = NULL;
 	opts = 0;
+	bench = -1;
+	size = 0;
+	partial = 0;
+	elem = ELEM_U16;
+	seed = 0;
+	has_seed = 0;
+	external = NULL;
+	output = NULL;
+	chunk = EXTSORT_DEFAULT_CHUNK;
+	algo = INTRO_SORT;
+	input = NULL;
+	mapflags = 0;
+	view = 0;
+	file = NULL;
 
 	for (;;) {
 		c = getopt_long(ac, av, "fd:", long_options, NULL);
@@ -59,13 +258,124 @@ int main(int ac, char *av[])
 
 		switch (c) {
 		case OPT_HELP:
-			printf(USAGE_FMT, VERSION, *av, DATADIR);
+			printf(USAGE_FMT, VERSION, *av, DATADIR,
+			       ARRAY_DEFAULT_SIZE);
 			return 0;
 
 		case OPT_DISPLAY:
  			setenv("DISPLAY", optarg, 1);
 			break;
 
+		case OPT_BENCH:
+			if (!optarg || !strcmp(optarg, "csv")) {
+				bench = BENCH_FORMAT_CSV;
+			}
+			else if (!strcmp(optarg, "json")) {
+				bench = BENCH_FORMAT_JSON;
+			}
+			else {
+				printf("%s: unknown bench format `%s'\n",
+				       av[0], optarg);
+				return 1;
+			}
+			break;
+
+		case OPT_SIZE:
+			size = strtoul(optarg, &end, 10);
+			if (*end || !size || size > INT_MAX) {
+				printf("%s: invalid size `%s'\n",
+				       av[0], optarg);
+				return 1;
+			}
+			break;
+
+		case OPT_THREADS:
+			threads = strtoul(optarg, &end, 10);
+			if (*end || threads > INT_MAX ||
+			    sort_set_threads(threads) != 0) {
+				printf("%s: invalid number of threads `%s'\n",
+				       av[0], optarg);
+				return 1;
+			}
+			break;
+
+		case OPT_SEED:
+			errno = 0;
+			seed = strtoull(optarg, &end, 10);
+			if (*end || !*optarg || errno) {
+				printf("%s: invalid seed `%s'\n",
+				       av[0], optarg);
+				return 1;
+			}
+			has_seed = 1;
+			break;
+
+		case OPT_TYPE:
+			for (elem=0; elem<SORT_ELEM_COUNT; ++elem)
+				if (!strcmp(optarg, sort_elem_name(elem)))
+					break;
+
+			if (elem == SORT_ELEM_COUNT) {
+				printf("%s: unknown element type `%s'\n",
+				       av[0], optarg);
+				return 1;
+			}
+			break;
+
+		case OPT_EXTERNAL:
+			external = optarg;
+			break;
+
+		case OPT_OUTPUT:
+			output = optarg;
+			break;
+
+		case OPT_CHUNK:
+			if (parse_bytes(optarg, &chunk) != 0) {
+				printf("%s: invalid chunk size `%s'\n",
+				       av[0], optarg);
+				return 1;
+			}
+			break;
+
+		case OPT_ALGO:
+			algo = parse_algo(optarg);
+			if (algo < 0) {
+				printf("%s: unknown algorithm `%s'\n",
+				       av[0], optarg);
+				return 1;
+			}
+			break;
+
+		case OPT_INPUT:
+			input = optarg;
+			break;
+
+		case OPT_STABLE:
+			sort_set_stable(1);
+			break;
+
+		case OPT_PARTIAL:
+			partial = strtoul(optarg, &end, 10);
+			if (*end || !partial || partial > INT_MAX) {
+				printf("%s: invalid number of elements `%s'\n",
+				       av[0], optarg);
+				return 1;
+			}
+			break;
+
+		case OPT_LIVE:
+			opts |= ENGINE_OPTION_LIVE;
+			break;
+
+		case OPT_IN_PLACE:
+			mapflags |= MAPFILE_IN_PLACE;
+			break;
+
+		case OPT_VIEW:
+			view = 1;
+			break;
+
 		case 'f':
 			opts |= ENGINE_OPTION_FS;
 			break;
@@ -81,11 +391,52 @@ int main(int ac, char *av[])
 		}
 	}
 
-	if (engine_init(opts, datadir) != 0)
+	if (external) {
+		retv = run_external(external, output ? output : external,
+				    elem, algo, chunk);
+		sort_quit();
+		return retv;
+	}
+
+	if (bench != -1) {
+		retv = bench_run(bench, size, elem, has_seed ? seed : 1) ? 1 : 0;
+		sort_quit();
+		return retv;
+	}
+
+	if (input) {
+		file = mapfile_new(input, elem, mapflags);
+		if (!file)
+			return 1;
+
+		if (!view) {
+			retv = run_input(file, input, algo);
+			mapfile_free(file);
+			sort_quit();
+			return retv;
+		}
+	}
+
+	/* log the seed, so that the session can be replayed: */
+	if (!has_seed)
+		seed = time(NULL);
+	log_info("seed: %llu", seed);
+
+	/* sorting every element is no partial sort: */
+	if (partial >= (file ? mapfile_get_size(file) :
+			size ? size : ARRAY_DEFAULT_SIZE))
+		partial = 0;
+
+	if (engine_init(opts, datadir, size, seed, file, partial) != 0) {
+		mapfile_free(file);
+		sort_quit();
 		return 1;
+	}
 
 	engine_loop();
 	engine_quit();
+	mapfile_free(file);
+	sort_quit();
 
 	return 0;
 }
@@ -0,0 +1,207 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "log.h"
+#include "mapfile.h"
+
+struct _MapFile {
+	char *path;
+	int fd;
+	int flags;
+
+	void *data;		/* NULL for empty files */
+	size_t bytes;
+	u32 n;
+	SortElem elem;
+};
+
+/*
+ * Map the whole file.
+ */
+static int mapfile_map(MapFile *self)
+{
+	int prot, share;
+
+	if (!self->bytes)
+		return 0;
+
+	prot = PROT_READ | PROT_WRITE;
+	share = self->flags & MAPFILE_IN_PLACE ? MAP_SHARED : MAP_PRIVATE;
+
+	self->data = mmap(NULL, self->bytes, prot, share, self->fd, 0);
+	if (self->data == MAP_FAILED) {
+		log_err("mapfile: could not map %s: %s", self->path,
+			strerror(errno));
+		self->data = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void mapfile_unmap(MapFile *self)
+{
+	if (self->data)
+		munmap(self->data, self->bytes);
+
+	self->data = NULL;
+}
+
+MapFile *mapfile_new(const char *path, SortElem elem, int flags)
+{
+	MapFile *self;
+	struct stat sb;
+	size_t size;
+
+	size = sort_elem_size(elem);
+	if (!size) {
+		log_fixme("unknown element type: #%d", elem);
+		return NULL;
+	}
+
+	self = calloc(1, sizeof(MapFile));
+	if (!self)
+		return NULL;
+
+	self->flags = flags;
+	self->elem = elem;
+	self->path = strdup(path);
+
+	/* private mappings may be written even over a read-only file: */
+	self->fd = open(path, flags & MAPFILE_IN_PLACE ? O_RDWR : O_RDONLY);
+	if (self->fd < 0) {
+		log_err("mapfile: could not open %s: %s", path,
+			strerror(errno));
+		goto error;
+	}
+
+	if (fstat(self->fd, &sb) != 0) {
+		log_err("mapfile: %s: %s", path, strerror(errno));
+		goto error;
+	}
+
+	if (sb.st_size % size) {
+		log_err("mapfile: the size of %s is not a multiple of %lu "
+			"bytes", path, (unsigned long)size);
+		goto error;
+	}
+
+	if (sb.st_size / size > INT_MAX) {
+		log_err("mapfile: %s holds more than %d elements", path,
+			INT_MAX);
+		goto error;
+	}
+
+	self->bytes = sb.st_size;
+	self->n = sb.st_size / size;
+
+	if (mapfile_map(self) != 0)
+		goto error;
+
+	return self;
+
+error:
+	mapfile_free(self);
+	return NULL;
+}
+
+void mapfile_free(MapFile *self)
+{
+	if (!self)
+		return;
+
+	mapfile_unmap(self);
+
+	if (self->fd >= 0)
+		close(self->fd);
+
+	free(self->path);
+	free(self);
+}
+
+INLINE void *mapfile_get_data(const MapFile *self)
+{
+	return self->data;
+}
+
+INLINE u32 mapfile_get_size(const MapFile *self)
+{
+	return self->n;
+}
+
+INLINE SortElem mapfile_get_elem(const MapFile *self)
+{
+	return self->elem;
+}
+
+void mapfile_advise(MapFile *self, SortType algo)
+{
+	int advice;
+
+	if (!self->data)
+		return;
+
+	switch (algo) {
+	case HEAP_SORT:
+	case DARY_HEAP_SORT:
+		advice = MADV_RANDOM;
+		break;
+
+	case PARALLEL_QUICK_SORT:
+	case PARALLEL_MERGE_SORT:
+	case PARALLEL_SAMPLE_SORT:
+		advice = MADV_NORMAL;
+		break;
+
+	default:
+		advice = MADV_SEQUENTIAL;
+	}
+
+	if (madvise(self->data, self->bytes, advice) != 0)
+		log_warn("mapfile: madvise: %s", strerror(errno));
+}
+
+int mapfile_reset(MapFile *self)
+{
+	if (self->flags & MAPFILE_IN_PLACE)
+		return 0;
+
+	mapfile_unmap(self);
+
+	return mapfile_map(self);
+}
+
+int mapfile_sync(MapFile *self)
+{
+	if (!(self->flags & MAPFILE_IN_PLACE) || !self->data)
+		return 0;
+
+	if (msync(self->data, self->bytes, MS_SYNC) != 0) {
+		log_err("mapfile: could not write %s back: %s", self->path,
+			strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,65 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include "stdinc.h"
+#include "sort.h"
+
+/*
+ * Binary files of elements mapped in memory, to be sorted where they are.
+ */
+
+typedef struct _MapFile MapFile;
+
+enum MapFileFlags {
+	MAPFILE_IN_PLACE=	1 << 0,	/* write the changes back to the file */
+};
+
+/*
+ * MapFile ctor: map `path' as an array of elements of type `elem'
+ * (in native byte order). Unless `flags' has MAPFILE_IN_PLACE the mapping
+ * is private: sorting it leaves the file untouched.
+ * On error a NULL pointer is returned.
+ */
+MapFile *mapfile_new  (const char *path, SortElem elem, int flags);
+void     mapfile_free (MapFile *self);
+
+void    *mapfile_get_data (const MapFile *self);
+u32      mapfile_get_size (const MapFile *self);
+SortElem mapfile_get_elem (const MapFile *self);
+
+/*
+ * Tell the kernel how `algo' is going to walk the mapping: sequentially,
+ * randomly (heaps) or in several streams at once (parallel algorithms).
+ */
+void mapfile_advise (MapFile *self, SortType algo);
+
+/*
+ * Give a private mapping the content of the file back (a no-op in place).
+ * Return 0, or -1 on error, the mapping being lost.
+ */
+int mapfile_reset (MapFile *self);
+
+/*
+ * Write the changes of an in-place mapping to the file (a no-op for
+ * private mappings). Return 0, or -1 on error.
+ */
+int mapfile_sync (MapFile *self);
+
+#endif /* !MAPFILE_H */
@@ -20,8 +20,13 @@
 #include "engine.h"
 
 #include "sprite.h"
+#include "sort.h"
 #include "menu.h"
 
+#if HAVE_LIBSDL_TTF
+# include "text.h"
+#endif
+
 #define SELECTOR_WIDTH		350
 #define SELECTOR_HEIGHT		42
 #define SELECTOR_X		72
@@ -29,8 +34,12 @@
 #define SELECTOR_STEP		48
 #define SELECTOR_COLOR		0x00ff55
 
-#define SELECTOR0_MAX_VAL	4
-#define SELECTOR1_MAX_VAL	3
+/* rows drawn at once; longer menus scroll: */
+#define MENU_ROWS		5
+
+/* entries painted in the bitmaps: */
+#define MENU0_BITMAP_ITEMS	5
+#define MENU1_BITMAP_ITEMS	4
 
 #define ALPHA_COLOR		0xff00ff
 #define BG_COLOR		0x0f0f0f
@@ -38,12 +47,23 @@
 #define MENU0_FILENAME	"menu0.bmp"
 #define MENU1_FILENAME	"menu1.bmp"
 
+#if HAVE_LIBSDL_TTF
+# define ITEM_COLOR		0xdedede
+# define ITEM_PTS		20
+#endif
+
 struct _Menu {
 	ObjectVT parent;
 
 	Sprite *menu;
 	Sprite *selector;
 
+#if HAVE_LIBSDL_TTF
+	Text **items;
+#endif
+
+	u8 nitems;
+	u8 first;		/* first visible row */
 	u8 value;
 	u8 type;
 };
@@ -57,16 +77,116 @@ static void _menu_select(Menu *self, u8 idx)
 		menu_down(self);
 }
 
+/*
+ * Move the selector on the row of the current value.
+ */
+INLINE static void menu_place_selector(Menu *self)
+{
+	layer_set_y(self->selector,
+		    SELECTOR_Y + SELECTOR_STEP * (self->value - self->first));
+}
+
 INLINE_METHOD static void menu_free(Menu *self)
 {
+#if HAVE_LIBSDL_TTF
+	u8 i;
+
+	if (self->items) {
+		for (i=0; i<self->nitems; ++i)
+			object_free(self->items[i]);
+		free(self->items);
+	}
+#endif
+
 	objects_free(self->menu, self->selector, NULL);
 }
 
-INLINE_METHOD static int menu_blit(Menu *self)
+static int menu_blit(Menu *self)
 {
+#if HAVE_LIBSDL_TTF
+	u8 i;
+	int retv;
+
+	retv = object_blit(self->menu);
+
+	if (self->items) {
+		for (i=self->first; i<self->nitems &&
+			     i<self->first+MENU_ROWS; ++i)
+			retv |= object_blit(self->items[i]);
+	}
+
+	return retv | object_blit(self->selector);
+#else
  	return objects_blit(self->menu, self->selector, NULL);
+#endif
+}
+
+#if HAVE_LIBSDL_TTF
+
+/*
+ * Replace the painted entries with one label per SortType (or SortCase),
+ * so that the menu can list more entries than the bitmap does.
+ * On error the bitmap entries are kept.
+ */
+static void menu_load_items(Menu *self, u8 count)
+{
+	char path[PATH_MAX];
+	const char *label;
+	Text *item;
+	u8 i;
+
+	join_path(engine_get_datadir(), FONT_FILENAME, path);
+
+	self->items = calloc(count, sizeof(Text *));
+	if (!self->items)
+		return;
+
+	for (i=0; i<count; ++i) {
+		label = self->type ? sort_case_name(i) : sort_algo_name(i);
+		item = text_new(path, ITEM_PTS, ITEM_COLOR);
+		if (!item || text_set_text(item, "%s", label) != 0) {
+			if (item)
+				object_free(item);
+
+			while (i--)
+				object_free(self->items[i]);
+			free(self->items);
+			self->items = NULL;
+			return;
+		}
+
+		self->items[i] = item;
+	}
+
+	sprite_fill_region(self->menu, SELECTOR_X, SELECTOR_Y,
+			   SELECTOR_WIDTH, SELECTOR_STEP * MENU_ROWS, BG_COLOR);
+	self->nitems = count;
+}
+
+/*
+ * Center the visible labels on their rows.
+ */
+static void menu_place_items(Menu *self)
+{
+	u8 i;
+	s16 x, y;
+
+	if (!self->items)
+		return;
+
+	for (i=self->first; i<self->nitems && i<self->first+MENU_ROWS; ++i) {
+		x = SELECTOR_X + 
+			(SELECTOR_WIDTH - layer_get_width(self->items[i])) / 2;
+		y = SELECTOR_Y + SELECTOR_STEP * (i - self->first) +
+			(SELECTOR_HEIGHT - layer_get_height(self->items[i])) / 2;
+		layer_set_xy(self->items[i], x, y);
+	}
 }
 
+#else
+# define menu_place_items(SELF)	/* nothing */
+#endif /* HAVE_LIBSDL_TTF */
+
 Menu *menu_new(int type)
 {
 	char path[PATH_MAX];
@@ -87,6 +207,14 @@ Menu *menu_new(int type)
 
 	self->menu = sprite_new_from_file(path);
 
+	/* without labels only the painted entries can be selected: */
+	self->nitems = type ? MENU1_BITMAP_ITEMS : MENU0_BITMAP_ITEMS;
+
+#if HAVE_LIBSDL_TTF
+	menu_load_items(self, type ? SORT_CASE_COUNT : SORT_TYPE_COUNT);
+	menu_place_items(self);
+#endif
+
 	sprite_set_accel(self->menu, 0x0f0f0f);
  	sprite_set_alpha(self->selector, 64);
 
@@ -95,68 +223,56 @@ Menu *menu_new(int type)
 
 bool menu_up(Menu *self)
 {
-	s16 y;
-
 	if (self->value == 0)
 		return 0;
 
-	y = layer_get_y(self->selector);
-	layer_set_y(self->selector, y - SELECTOR_STEP);
 	--self->value;
 
+	if (self->value < self->first) {
+		self->first = self->value;
+		menu_place_items(self);
+	}
+
+	menu_place_selector(self);
+
 	return 1;
 }
 
 bool menu_down(Menu *self)
 {
-	s16 y = layer_get_y(self->selector);
+	if (self->value + 1 >= self->nitems)
+		return 0;
 
-	if (self->type == 0) {
-		if (self->value < SELECTOR0_MAX_VAL) {
-			layer_set_y(self->selector, y + SELECTOR_STEP);
+	++self->value;
 
-			++self->value;
-		}
-		else {
-			return 0;
-		}
-	}
-	else {
-		if (self->value < SELECTOR1_MAX_VAL) {
-			layer_set_y(self->selector, y + SELECTOR_STEP);
-			++self->value;
-		}
-		else {
-			return 0;
-		}
+	if (self->value >= self->first + MENU_ROWS) {
+		self->first = self->value - MENU_ROWS + 1;
+		menu_place_items(self);
 	}
 
+	menu_place_selector(self);
+
 	return 1;
 }
 
 bool menu_select(Menu *self, u16 x, u16 y)
 {
 	int i;
-	u16 sy, lim;
+	u16 sy;
 
 	if (x < SELECTOR_X || x >= SELECTOR_X + SELECTOR_WIDTH)
 		return 0;
 
-	if (self->type == 0)
-		lim = SELECTOR0_MAX_VAL;
-	else
-		lim = SELECTOR1_MAX_VAL;
-
-	for (i=0; i<=lim; ++i) {
+	for (i=0; i<MENU_ROWS && self->first+i<self->nitems; ++i) {
 		sy = SELECTOR_Y + SELECTOR_STEP * i;
 		if (y >= sy && y < sy + SELECTOR_HEIGHT)
 			break;
 	}
 
-	if (i > lim)
+	if (i == MENU_ROWS || self->first + i >= self->nitems)
 		return 0;
 
-	_menu_select(self, i);
+	_menu_select(self, self->first + i);
 
 	return 1;
 }
@@ -165,4 +281,3 @@ INLINE_METHOD u8 menu_get_value(const Menu *self)
 {
 	return self->value;
 }
-
@@ -0,0 +1,219 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+
+#ifdef __linux__
+# include <unistd.h>
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+# include <linux/perf_event.h>
+#endif
+
+#include "log.h"
+#include "perf.h"
+
+#define PERF_GROUPS	2
+
+#ifdef __linux__
+
+#define CACHE_MISS(CACHE)						\
+	(PERF_COUNT_HW_CACHE_##CACHE |					\
+	 PERF_COUNT_HW_CACHE_OP_READ << 8 |				\
+	 PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+
+static const struct {
+	u32 type;
+	u64 config;
+	u8 group;
+} PERF_EVENTS[PERF_COUNTER_COUNT] = {
+	[PERF_CYCLES] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 0 },
+	[PERF_INSTRUCTIONS] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 0 },
+	[PERF_BRANCH_MISSES] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, 0 },
+	[PERF_L1D_MISSES] = {
+		PERF_TYPE_HW_CACHE, CACHE_MISS(L1D), 1 },
+	[PERF_LLC_MISSES] = {
+		PERF_TYPE_HW_CACHE, CACHE_MISS(LL), 1 },
+	[PERF_DTLB_MISSES] = {
+		PERF_TYPE_HW_CACHE, CACHE_MISS(DTLB), 1 },
+};
+
+#endif /* __linux__ */
+
+static const char *PERF_STRCOUNTER[PERF_COUNTER_COUNT] = {
+	"cycles", "instructions", "branch misses",
+	"L1D misses", "LLC misses", "dTLB misses",
+};
+
+struct _Perf {
+	int fd[PERF_COUNTER_COUNT];		/* -1 if not opened */
+	int leader[PERF_GROUPS];		/* -1 if the group is empty */
+};
+
+#ifdef __linux__
+
+/*
+ * Open `counter' in the group of `leader' (or as the leader of a new group
+ * if it is -1) and return its fd, or -1.
+ */
+static int perf_open(PerfCounter counter, int leader)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_EVENTS[counter].type;
+	attr.config = PERF_EVENTS[counter].config;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+			   PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr.disabled = leader == -1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+#endif /* __linux__ */
+
+Perf *perf_new(void)
+{
+	Perf *self;
+	int i, err;
+	u8 g;
+
+	self = malloc(sizeof(Perf));
+	if (!self)
+		return NULL;
+
+	for (i=0; i<PERF_COUNTER_COUNT; ++i)
+		self->fd[i] = -1;
+
+	for (g=0; g<PERF_GROUPS; ++g)
+		self->leader[g] = -1;
+
+	err = ENOSYS;
+
+#ifdef __linux__
+	for (i=0; i<PERF_COUNTER_COUNT; ++i) {
+		g = PERF_EVENTS[i].group;
+
+		self->fd[i] = perf_open(i, self->leader[g]);
+		if (self->fd[i] < 0) {
+			err = errno;
+			continue;
+		}
+
+		if (self->leader[g] == -1)
+			self->leader[g] = self->fd[i];
+	}
+#endif
+
+	if (!perf_available(self))
+		log_warn("perf: no hardware counters available: %s",
+			 strerror(err));
+
+	return self;
+}
+
+void perf_free(Perf *self)
+{
+	int i;
+
+	if (!self)
+		return;
+
+#ifdef __linux__
+	for (i=0; i<PERF_COUNTER_COUNT; ++i)
+		if (self->fd[i] >= 0)
+			close(self->fd[i]);
+#else
+	(void)i;
+#endif
+
+	free(self);
+}
+
+bool perf_available(const Perf *self)
+{
+	u8 g;
+
+	for (g=0; g<PERF_GROUPS; ++g)
+		if (self->leader[g] >= 0)
+			return 1;
+
+	return 0;
+}
+
+void perf_start(Perf *self)
+{
+#ifdef __linux__
+	u8 g;
+
+	for (g=0; g<PERF_GROUPS; ++g) {
+		if (self->leader[g] < 0)
+			continue;
+
+		ioctl(self->leader[g], PERF_EVENT_IOC_RESET,
+		      PERF_IOC_FLAG_GROUP);
+		ioctl(self->leader[g], PERF_EVENT_IOC_ENABLE,
+		      PERF_IOC_FLAG_GROUP);
+	}
+#endif
+}
+
+void perf_stop(Perf *self, PerfSample *sample)
+{
+	int i;
+#ifdef __linux__
+	u64 buf[3];		/* value, time enabled, time running */
+	u8 g;
+
+	for (g=0; g<PERF_GROUPS; ++g)
+		if (self->leader[g] >= 0)
+			ioctl(self->leader[g], PERF_EVENT_IOC_DISABLE,
+			      PERF_IOC_FLAG_GROUP);
+#endif
+
+	memset(sample, 0, sizeof(*sample));
+
+	for (i=0; i<PERF_COUNTER_COUNT; ++i) {
+		if (self->fd[i] < 0)
+			continue;
+
+#ifdef __linux__
+		if (read(self->fd[i], buf, sizeof(buf)) != sizeof(buf) ||
+		    !buf[2])
+			continue;
+
+		/* scale the value up if the group was multiplexed: */
+		sample->value[i] = buf[2] < buf[1] ?
+			(double)buf[0] * buf[1] / buf[2] : buf[0];
+		sample->valid[i] = 1;
+#endif
+	}
+}
+
+const char *perf_counter_name(PerfCounter counter)
+{
+	if (counter < 0 || counter >= PERF_COUNTER_COUNT)
+		return NULL;
+
+	return PERF_STRCOUNTER[counter];
+}
@@ -0,0 +1,76 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#include "stdinc.h"
+
+/*
+ * Hardware performance counters of the calling thread, through Linux
+ * perf_event_open(2).
+ *
+ * The counters are opened in two groups, {cycles, instructions, branch
+ * misses} and {L1D, LLC and dTLB misses}, each small enough to be
+ * scheduled on the PMU at once; when the kernel multiplexes them, their
+ * values are scaled to the whole measure. Counters that cannot be opened
+ * (not permitted, not supported, not Linux) are just left out.
+ */
+
+typedef enum {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_BRANCH_MISSES,
+	PERF_L1D_MISSES,
+	PERF_LLC_MISSES,
+	PERF_DTLB_MISSES,
+
+	PERF_COUNTER_COUNT
+} PerfCounter;
+
+typedef struct {
+	u64 value[PERF_COUNTER_COUNT];
+	bool valid[PERF_COUNTER_COUNT];
+} PerfSample;
+
+typedef struct _Perf Perf;
+
+/*
+ * Perf ctor: open every counter that can be opened.
+ * On error (out of memory) a NULL pointer is returned.
+ */
+Perf *perf_new  (void);
+void  perf_free (Perf *self);
+
+/*
+ * Return 1 if at least one counter could be opened.
+ */
+bool perf_available (const Perf *self);
+
+/*
+ * Reset and start the counters, then stop them and store what they
+ * counted in `sample'.
+ */
+void perf_start (Perf *self);
+void perf_stop  (Perf *self, PerfSample *sample);
+
+/*
+ * Human readable names (NULL for unknown values).
+ */
+const char *perf_counter_name (PerfCounter counter);
+
+#endif /* !PERF_H */
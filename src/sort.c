@@ -0,0 +1,1404 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _SORT_INSIDE
+
+#include <float.h>
+#include <limits.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__SSE4_1__)
+# include <smmintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#include "log.h"
+#include "wsched.h"
+#include "dist.h"
+#include "vpart.h"
+#include "sort.h"
+
+/* elements generated by a task of sort_fill(): */
+#define FILL_BLOCK	(1 << 16)
+
+/* runs sorted by insertion before merging: */
+#define MERGE_RUN	16
+
+/* largest range sorted by the network leaves: */
+#define NETWORK_MAX	64
+
+/* elements scanned per side by a step of the block partition (their
+ * offsets must fit a byte): */
+#define PARTITION_BLOCK	64
+
+/* introsort: insertion sort below, ninther pivot above, and the moves
+ * allowed to the insertion sort of an already partitioned range: */
+#define INTRO_INSERTION	24
+#define INTRO_NINTHER	128
+#define INTRO_PARTIAL	8
+
+/* sample sort: buckets (up to 256, a byte per element tells the bucket),
+ * sample keys per bucket, smallest average bucket and most blocks of the
+ * classification: */
+#define SAMPLE_BUCKETS		256
+#define SAMPLE_OVERSAMPLING	16
+#define SAMPLE_MIN		16
+#define SAMPLE_BLOCKS		64
+
+/* sample sort: bytes apart of the writes placing the buckets on pages: */
+#define SAMPLE_PAGE		4096
+
+/* default children per node of the d-ary heap: */
+#define HEAP_ARITY	4
+
+/* timsort: smallest array merged, keys won in a row before galloping
+ * and the size of the run stack: */
+#define TIM_MINMERGE	64
+#define TIM_GALLOP	7
+#define TIM_STACK	85
+
+/* widest key range of the counting sort, in all and per element: */
+#define COUNTING_MAX	(1 << 20)
+#define COUNTING_SPREAD	4
+
+/* radix sort digits: */
+#define RADIX_BITS	8
+#define RADIX_BUCKETS	(1 << RADIX_BITS)
+
+/* automatic choice: most keys sampled, arrays left to insertion sort, the
+ * shortest average run and the fewest sampled inversions (per mille)
+ * merged by tim sort, the smallest array worth the radix passes and how
+ * much wider than in the sample the key range is taken to be: */
+#define AUTO_SAMPLE	32
+#define AUTO_SMALL	32
+#define AUTO_RUN	32
+#define AUTO_PRESORTED	10
+#define AUTO_RADIX	256
+#define AUTO_RANGE	4
+
+typedef struct {
+	void *tmp;		/* holds the smaller run of a merge */
+	int min_gallop;
+	int size;
+	int base[TIM_STACK];
+	int len[TIM_STACK];
+} TimState;
+
+/*
+ * An input being generated by sort_fill().
+ */
+typedef struct {
+	u64 *v;
+	u32 n;
+	SortCase kase;
+	u64 seed;
+} FillJob;
+
+/*
+ * A merge pass of the parallel merge sort: runs of `width' elements of
+ * `src' are merged pairwise into `dst'.
+ */
+typedef struct {
+	void *src;
+	void *dst;
+	void *v;		/* the array being sorted */
+	int n;
+	int width;
+} MergePass;
+
+/*
+ * The parallel sample sort: `n' elements, in `nblocks' blocks of `block',
+ * go into 2^`log' buckets split by the splitters of `tree'. With `equal',
+ * every bucket 2j is followed by the equality bucket 2j+1 of the keys
+ * equal to its splitter, which is not sorted.
+ */
+typedef struct {
+	void *v;		/* the array being sorted */
+	void *tmp;		/* the buckets */
+	const void *tree;	/* the splitters, in heap order from 1 */
+	const void *splitters;	/* the splitters, in order */
+	u8 *oracle;		/* bucket of every element */
+	u32 *count;		/* per block and bucket: sizes, then offsets */
+	u32 *bucket;		/* bucket starts, and the end */
+	u8 *owner;		/* worker which placed every bucket */
+	bool *claimed;		/* the bucket is being sorted */
+	u32 next;		/* next bucket to place */
+	TaskFunc step;		/* run on every block, or by every worker */
+	int n;
+	int block;
+	int nblocks;
+	int log;
+	int nbuckets;
+	bool equal;
+} SamplePass;
+
+/*
+ * A streaming top-k: the heap holds up to `k' elements of type `elem'.
+ */
+struct _SortTopK {
+	void *heap;
+	SortElem elem;
+	int k;
+	int size;
+};
+
+static const char *SORT_STRALGO[SORT_TYPE_COUNT] = {
+	"bubble sort", "selection sort", 
+	"insertion sort", "quick sort", "heap sort",
+	"block quick sort", "vector quick sort",
+	"parallel quick sort", "merge sort", "parallel merge sort",
+	"parallel sample sort",
+	"counting sort", "radix sort", "intro sort", "d-ary heap sort",
+	"tim sort", "auto",
+};
+
+static const char *SORT_STRCASE[SORT_CASE_COUNT] = {
+	"random", "reversed",
+	"nearly sorted", "few unique",
+	"zipf", "sawtooth", "organ pipe", "all equal", "k-sorted",
+	"sorted runs",
+};
+
+static const char *SORT_STRELEM[SORT_ELEM_COUNT] = {
+	"u16", "u32", "u64", "float", "double", "record",
+};
+
+static const size_t SORT_ELEM_SIZE[SORT_ELEM_COUNT] = {
+	sizeof(u16), sizeof(u32), sizeof(u64), sizeof(float),
+	sizeof(double), sizeof(SortRecord),
+};
+
+/*
+ * Operation counters of the instrumented kernels: every worker counts in
+ * its own slot, on its own cache line, and the slots are summed once the
+ * run is over.
+ */
+typedef struct {
+	SortStats stats;
+} __attribute__((aligned(64))) Counters;
+
+static Counters counters[SCHED_MAX_THREADS];
+static Trace *tracer;
+static bool tracer_lock;
+static u32 tracer_worker;
+
+static Sched *scheduler;
+static u32 nthreads;
+
+static bool leaves = 1;
+static bool stable;
+static u8 heap_arity = HEAP_ARITY;
+
+static SortProfile auto_profile;
+static bool auto_log = 1;
+
+static SortWatch *watch;
+static u32 parallel;		/* parallel phases in progress */
+
+#ifndef NO_SORT_STATS
+
+/*
+ * Slot of `counters' of the calling thread, looked up once: a thread keeps
+ * its worker id (and so its slot) for good. Held in a thread-local
+ * pointer, it is one load away from every count, and that load is hoisted
+ * out of the loops of the kernels.
+ */
+static __thread Counters *slot;
+
+INLINE static Counters *counted_slot(void)
+{
+	if (!slot)
+		slot = &counters[sched_self()];
+
+	return slot;
+}
+
+#endif /* !NO_SORT_STATS */
+
+/*
+ * Floating point keys: flipping the sign bit of the positive values and
+ * every bit of the negative ones gives unsigned integers of the same order.
+ */
+INLINE static u32 float_key(float x)
+{
+	u32 b;
+
+	memcpy(&b, &x, sizeof(b));
+
+	return b ^ (-(b >> 31) | 0x80000000u);
+}
+
+INLINE static float float_of_key(u32 k)
+{
+	float x;
+
+	k ^= ((k >> 31) - 1) | 0x80000000u;
+	memcpy(&x, &k, sizeof(x));
+
+	return x;
+}
+
+INLINE static u64 double_key(double x)
+{
+	u64 b;
+
+	memcpy(&b, &x, sizeof(b));
+
+	return b ^ (-(b >> 63) | 0x8000000000000000ull);
+}
+
+INLINE static double double_of_key(u64 k)
+{
+	double x;
+
+	k ^= ((k >> 63) - 1) | 0x8000000000000000ull;
+	memcpy(&x, &k, sizeof(x));
+
+	return x;
+}
+
+/*
+ * Finite floating point values of the same rank as the key `x' of
+ * sort_fill() among all of them: `x' is scaled down to the keys from
+ * -FLT_MAX (-DBL_MAX) to FLT_MAX (DBL_MAX), which leave out the
+ * infinities and the NaNs.
+ */
+INLINE static float float_of_fill(u64 x)
+{
+	u32 lo = float_key(-FLT_MAX);
+	u64 span = (u64)float_key(FLT_MAX) - lo + 1;
+
+	return float_of_key(lo + ((x >> 32) * span >> 32));
+}
+
+INLINE static double double_of_fill(u64 x)
+{
+	u64 lo = double_key(-DBL_MAX);
+
+	/* the span is 2^64 - 2^53: x * (1 - 2^-11), rounded down */
+	return double_of_key(lo + x - (x >> 11) - ((x & 0x7ff) != 0));
+}
+
+static u64 clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Integer square root of `x', by Newton's method.
+ */
+static u64 isqrt(u64 x)
+{
+	u64 r, y;
+
+	if (x < 2)
+		return x;
+
+	r = x;
+	y = (r + 1) / 2;
+	while (y < r) {
+		r = y;
+		y = (r + x / r) / 2;
+	}
+
+	return r;
+}
+
+/*
+ * Choose the kernel of an AUTO_SORT run of `n' elements from their
+ * profile; all of them are stable, and so AUTO_SORT is:
+ * - small arrays go to insertion sort;
+ * - a sample in order (sorted input, all keys equal) to tim sort, which
+ *   takes a single run in one pass;
+ * - key ranges narrower than the array to counting sort, the sampled
+ *   range being widened by AUTO_RANGE, since the sample can miss the
+ *   extremes (and counting sort leaves to radix sort the ranges it finds
+ *   too wide all the same);
+ * - long runs, or a sample nearly in order (local disorder only, as in
+ *   k-sorted input), to tim sort, which merges them;
+ * - the rest to radix sort, or to merge sort, on its network leaves, below
+ *   AUTO_RADIX elements.
+ */
+static SortType auto_choose(const SortProfile *p, u32 n)
+{
+	if (n < AUTO_SMALL)
+		return INSERTION_SORT;
+
+	if (p->runs == 1 && p->inversions == 0)
+		return TIM_SORT;
+
+	if (p->range < COUNTING_MAX / AUTO_RANGE &&
+	    p->range * AUTO_RANGE < n)
+		return COUNTING_SORT;
+
+	if (p->runs <= n / AUTO_RUN ||
+	    p->inversions * 1000 < AUTO_PRESORTED)
+		return TIM_SORT;
+
+	if (n >= AUTO_RADIX)
+		return RADIX_SORT;
+
+	return MERGE_SORT;
+}
+
+/*
+ * Keep the profile of the last AUTO_SORT run, and log it.
+ */
+static void auto_done(const SortProfile *p, u32 n)
+{
+	auto_profile = *p;
+
+	if (!auto_log)
+		return;
+
+	log_info("auto: %s for %u elements (%u keys sampled: ~%llu runs, "
+		 "%.1f%% inversions, ~%llu distinct, range %llu), chosen "
+		 "in %llu ns", sort_algo_name(p->choice), n, p->sample,
+		 (unsigned long long)p->runs, 100 * p->inversions,
+		 (unsigned long long)p->distinct,
+		 (unsigned long long)p->range, (unsigned long long)p->ns);
+}
+
+/*
+ * Push an event on behalf of the running worker: parallel kernels have
+ * several producers, so pushes are serialized by a spinlock and a
+ * TRACE_WORKER event is recorded whenever the producer changes.
+ */
+static void trace_emit(u8 op, u32 a, u32 b)
+{
+	u32 id = sched_self();
+
+	while (__atomic_test_and_set(&tracer_lock, __ATOMIC_ACQUIRE))
+		sched_yield();
+
+	if (id != tracer_worker) {
+		trace_push(tracer, TRACE_WORKER, id, 0);
+		tracer_worker = id;
+	}
+
+	trace_push(tracer, op, a, b);
+
+	__atomic_clear(&tracer_lock, __ATOMIC_RELEASE);
+}
+
+/*
+ * Task entry points of the parallel kernels: with no scheduler the tasks
+ * are run right away by the calling thread.
+ */
+static void tasks_run(TaskFunc f, void *ctx, u32 a, u32 b)
+{
+	Task t = { f, ctx, a, b };
+
+	if (scheduler) {
+		__atomic_add_fetch(&parallel, 1, __ATOMIC_RELAXED);
+		sched_run(scheduler, f, ctx, a, b);
+		__atomic_sub_fetch(&parallel, 1, __ATOMIC_RELAXED);
+	}
+	else {
+		f(&t);
+	}
+}
+
+/*
+ * Safe point of a watched run: take the snapshot asked for, unless other
+ * workers may be moving the elements, and tell if the run must stop.
+ */
+static bool watch_poll(void)
+{
+	u32 i;
+
+	if (__atomic_load_n(&watch->wanted, __ATOMIC_ACQUIRE) &&
+	    !__atomic_load_n(&parallel, __ATOMIC_RELAXED)) {
+		for (i=0; i<watch->nkeys; ++i)
+			watch->keys[i] = sort_elem_key(watch->v,
+					(u64)i * watch->n / watch->nkeys,
+					watch->elem);
+
+		__atomic_store_n(&watch->wanted, 0, __ATOMIC_RELEASE);
+	}
+
+	return __atomic_load_n(&watch->cancel, __ATOMIC_RELAXED);
+}
+
+static void tasks_spawn(TaskFunc f, void *ctx, u32 a, u32 b)
+{
+	Task t = { f, ctx, a, b };
+
+	if (scheduler)
+		sched_spawn(scheduler, f, ctx, a, b);
+	else
+		f(&t);
+}
+
+#if defined(__SSE2__)
+
+/*
+ * SSE merge: two sorted vectors of 8 keys are merged by a bitonic network,
+ * the lower half is stored and the upper half is merged with the next
+ * vector of the input whose head is smaller.
+ * SSE2 has no unsigned 16-bit min/max, so without SSE4.1 the keys are
+ * biased into signed ones while in the registers.
+ */
+# if defined(__SSE4_1__)
+#  define VMIN(A, B)	_mm_min_epu16(A, B)
+#  define VMAX(A, B)	_mm_max_epu16(A, B)
+#  define VBIAS(X)	(X)
+# else
+#  define VMIN(A, B)	_mm_min_epi16(A, B)
+#  define VMAX(A, B)	_mm_max_epi16(A, B)
+#  define VBIAS(X)	_mm_xor_si128(X, _mm_set1_epi16(-0x8000))
+# endif
+
+# define VLOAD(P)	VBIAS(_mm_loadu_si128((const __m128i *)(P)))
+# define VSTORE(P, X)	_mm_storeu_si128((__m128i *)(P), VBIAS(X))
+
+/*
+ * Compare-exchange every lane with its partner, keeping the minimum
+ * where `mask' is 0 and the maximum where it is all ones.
+ */
+INLINE static __m128i vexchange(__m128i x, __m128i y, __m128i mask)
+{
+	return _mm_or_si128(_mm_andnot_si128(mask, VMIN(x, y)),
+			    _mm_and_si128(mask, VMAX(x, y)));
+}
+
+/*
+ * Sort a bitonic vector.
+ */
+INLINE static __m128i vbitonic(__m128i x)
+{
+	const __m128i m2 = _mm_set_epi32(-1, 0, -1, 0);
+	const __m128i m1 = _mm_set_epi16(-1, 0, -1, 0, -1, 0, -1, 0);
+	__m128i y;
+
+	y = _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2));
+	x = _mm_unpacklo_epi64(VMIN(x, y), VMAX(x, y));
+
+	y = _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1));
+	x = vexchange(x, y, m2);
+
+	y = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1)),
+				_MM_SHUFFLE(2, 3, 0, 1));
+	return vexchange(x, y, m1);
+}
+
+/*
+ * Merge two sorted vectors: `a' gets the 8 smallest keys, `b' the others.
+ */
+INLINE static void vmerge(__m128i *a, __m128i *b)
+{
+	__m128i r, lo, hi;
+
+	/* reverse `b', so that a:b is bitonic */
+	r = _mm_shuffle_epi32(*b, _MM_SHUFFLE(0, 1, 2, 3));
+	r = _mm_shufflehi_epi16(_mm_shufflelo_epi16(r, _MM_SHUFFLE(2, 3, 0, 1)),
+				_MM_SHUFFLE(2, 3, 0, 1));
+
+	lo = VMIN(*a, r);
+	hi = VMAX(*a, r);
+
+	*a = vbitonic(lo);
+	*b = vbitonic(hi);
+}
+
+static void merge_vector(const u16 *src, u16 *dst, int i, int m, int j,
+			 int r, int k, int end)
+{
+	__m128i a, b;
+	u16 hi[8];
+	int h, nh;
+
+	h = nh = 0;
+
+	if (m - i >= 8 && r - j >= 8 && end - k >= 8) {
+		a = VLOAD(src + i);
+		b = VLOAD(src + j);
+		i += 8;
+		j += 8;
+
+		for (;;) {
+			vmerge(&a, &b);
+			VSTORE(dst + k, a);
+			k += 8;
+
+			if (end - k < 8)
+				break;
+
+			/* the next vector comes from the smaller head: */
+			if (j >= r || (i < m && src[i] <= src[j])) {
+				if (m - i < 8)
+					break;
+				a = VLOAD(src + i);
+				i += 8;
+			}
+			else {
+				if (r - j < 8)
+					break;
+				a = VLOAD(src + j);
+				j += 8;
+			}
+		}
+
+		VSTORE(hi, b);
+		nh = 8;
+	}
+
+	/* leftovers: the upper half still in the registers and the tails */
+	for (; k<end; ++k) {
+		if (h < nh && (i >= m || hi[h] <= src[i]) &&
+		    (j >= r || hi[h] <= src[j]))
+			dst[k] = hi[h++];
+		else if (j >= r || (i < m && src[i] <= src[j]))
+			dst[k] = src[i++];
+		else
+			dst[k] = src[j++];
+	}
+}
+
+/*
+ * Sort one vector of 8 keys by a bitonic network.
+ */
+INLINE static __m128i vsort8(__m128i x)
+{
+	__m128i y;
+
+	/* pairs, in alternate order */
+	y = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1)),
+				_MM_SHUFFLE(2, 3, 0, 1));
+	x = vexchange(x, y, _mm_set_epi16(0, -1, -1, 0, 0, -1, -1, 0));
+
+	/* quads, in alternate order */
+	y = _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1));
+	x = vexchange(x, y, _mm_set_epi16(0, 0, -1, -1, -1, -1, 0, 0));
+	y = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1)),
+				_MM_SHUFFLE(2, 3, 0, 1));
+	x = vexchange(x, y, _mm_set_epi16(0, -1, 0, -1, -1, 0, -1, 0));
+
+	return vbitonic(x);
+}
+
+/*
+ * Sort up to NETWORK_MAX keys: the input is padded to 8, 16, 32 or 64
+ * keys, every vector is sorted in its register and the vectors are then
+ * merged pairwise.
+ */
+static void network_vector(u16 *v, int n)
+{
+	u16 buf[2][NETWORK_MAX];
+	u16 *src, *dst, *t;
+	int i, size, w;
+
+	if (n < 2)
+		return;
+
+	for (size=8; size<n; size*=2)
+		;
+
+	memcpy(buf[0], v, n * sizeof(u16));
+	for (i=n; i<size; ++i)
+		buf[0][i] = 0xffff;
+
+	for (i=0; i<size; i+=8)
+		VSTORE(buf[0] + i, vsort8(VLOAD(buf[0] + i)));
+
+	src = buf[0];
+	dst = buf[1];
+
+	for (w=8; w<size; w*=2) {
+		for (i=0; i<size; i+=2*w)
+			merge_vector(src, dst, i, i+w, i+w, i+2*w, i, i+2*w);
+
+		t = src;
+		src = dst;
+		dst = t;
+	}
+
+	memcpy(v, src, n * sizeof(u16));
+}
+
+#endif /* __SSE2__ */
+
+/*
+ * Plain kernels: no accounting and no tracing at all.
+ */
+#define K(NAME)		KT(NAME##_fast)
+#define STEP(V, I, J)	/* nothing */
+#define LESS(A, B)	ELEM_LESS(A, B)
+#define SWAP(V, I, J)	K(swap)(&(V)[I], &(V)[J])
+#define MOVE(V, I, X)	((V)[I] = (X))
+#define READ_KEY(X)	KEY(X)
+#define CANCELLED()	0
+#define RANGE(V, L, R)	/* nothing */
+#define RUN(F, V, L, R)	tasks_run(F, V, L, R)
+#define SPAWN(F, V, L, R)	tasks_spawn(F, V, L, R)
+#define SPAWN_CUTOFF	4096
+#define SCRATCH(V, I, X)	((V)[I] = (X))
+#define MARK_RUN(V, L, R)	/* nothing */
+#define VECTOR_KERNELS
+
+#include "sort_elems.h"
+
+#undef K
+#undef STEP
+#undef LESS
+#undef SWAP
+#undef MOVE
+#undef READ_KEY
+#undef CANCELLED
+#undef RANGE
+#undef RUN
+#undef SPAWN
+#undef SPAWN_CUTOFF
+#undef SCRATCH
+#undef MARK_RUN
+#undef VECTOR_KERNELS
+
+/*
+ * Instrumented kernels: count every operation in the `counters' slot of
+ * the calling worker (unless NO_SORT_STATS), and stop or take a snapshot
+ * at the safe points of a watched run. Parallel kernels run on the
+ * workers as the plain ones do.
+ */
+#ifdef NO_SORT_STATS
+# define COUNT(FIELD, N)	((void)0)
+#else
+# define COUNT(FIELD, N)	(counted_slot()->stats.FIELD += (N))
+#endif
+
+#define K(NAME)		KT(NAME##_counted)
+#define STEP(V, I, J)	/* nothing */
+#define LESS(A, B)	(COUNT(cmps, 1), COUNT(reads, 2), ELEM_LESS(A, B))
+#define SWAP(V, I, J)	(COUNT(swaps, 1), K(swap)(&(V)[I], &(V)[J]))
+#define MOVE(V, I, X)	(COUNT(moves, 1), (V)[I] = (X))
+#define READ_KEY(X)	(COUNT(reads, 1), KEY(X))
+#define CANCELLED()	(watch && watch_poll())
+#define RANGE(V, L, R)	/* nothing */
+#define RUN(F, V, L, R)	tasks_run(F, V, L, R)
+#define SPAWN(F, V, L, R)	tasks_spawn(F, V, L, R)
+#define SPAWN_CUTOFF	4096
+#define SCRATCH(V, I, X)	(COUNT(moves, 1), (V)[I] = (X))
+#define MARK_RUN(V, L, R)	/* nothing */
+
+#include "sort_elems.h"
+
+#undef K
+#undef STEP
+#undef LESS
+#undef SWAP
+#undef MOVE
+#undef CANCELLED
+#undef RANGE
+#undef RUN
+#undef SPAWN
+#undef SPAWN_CUTOFF
+#undef SCRATCH
+#undef MARK_RUN
+#undef READ_KEY
+#undef COUNT
+
+/*
+ * Traced kernels: push every step, swap and write to `tracer', and stop as
+ * soon as it gets closed. Only the u16 kernels are traced.
+ * Parallel kernels split much smaller ranges, so that the work of every
+ * worker can be seen on the few elements of a visual run.
+ */
+#define K(NAME)		KT(NAME##_traced)
+#define STEP(V, I, J)	trace_emit(TRACE_CMP, I, J)
+#define LESS(A, B)	ELEM_LESS(A, B)
+#define SWAP(V, I, J)	(trace_emit(TRACE_SWAP, I, J),			\
+			 K(swap)(&(V)[I], &(V)[J]))
+#define MOVE(V, I, X)	(trace_emit(TRACE_WRITE, I, X),			\
+			 (V)[I] = (X))
+#define READ_KEY(X)	KEY(X)
+#define CANCELLED()	trace_is_closed(tracer)
+#define RANGE(V, L, R)	trace_emit(TRACE_RANGE, L, R)
+#define RUN(F, V, L, R)	tasks_run(F, V, L, R)
+#define SPAWN(F, V, L, R)	tasks_spawn(F, V, L, R)
+#define SPAWN_CUTOFF	16
+#define SCRATCH(V, I, X)	((V)[I] = (X))
+#define MARK_RUN(V, L, R)	trace_emit(TRACE_RUN, L, R)
+#define BUCKETS_IN_PLACE
+#define SORT_ELEMS_U16_ONLY
+
+#include "sort_elems.h"
+
+#undef K
+#undef STEP
+#undef LESS
+#undef SWAP
+#undef MOVE
+#undef READ_KEY
+#undef CANCELLED
+#undef RANGE
+#undef RUN
+#undef SPAWN
+#undef SPAWN_CUTOFF
+#undef SCRATCH
+#undef MARK_RUN
+#undef BUCKETS_IN_PLACE
+#undef SORT_ELEMS_U16_ONLY
+
+/*
+ * Generate v[a..b) of a FillJob, handing halves over to the other workers
+ * down to FILL_BLOCK elements.
+ */
+static void fill_task(const Task *t)
+{
+	const FillJob *job = t->ctx;
+	u32 a = t->a, b = t->b, m;
+
+	while (b - a > FILL_BLOCK) {
+		m = a + (b - a) / 2;
+		tasks_spawn(fill_task, t->ctx, m, b);
+		b = m;
+	}
+
+	dist_fill(job->v, job->n, a, b, job->kase, job->seed);
+}
+
+/*
+ * Generate the `n' keys of the case `kase' from `seed' into a new buffer
+ * (see dist.h). On error a NULL pointer is returned.
+ */
+static u64 *fill_keys(u32 n, SortCase kase, u64 seed)
+{
+	FillJob job = { NULL, n, kase, seed };
+
+	if (kase < 0 || kase >= SORT_CASE_COUNT) {
+		log_fixme("unknown case number: #%d", kase);
+		return NULL;
+	}
+
+	job.v = malloc(n * sizeof(u64));
+	if (!job.v) {
+		log_err("could not allocate %u keys", n);
+		return NULL;
+	}
+
+	if (!nthreads)
+		sort_set_threads(sort_get_threads());
+
+	if (n > FILL_BLOCK)
+		tasks_run(fill_task, &job, 0, n);
+	else
+		dist_fill(job.v, n, 0, n, kase, seed);
+
+	return job.v;
+}
+
+void sort_fill(u16 *v, u32 n, SortCase kase, u64 seed)
+{
+	u64 *keys;
+	u32 i;
+
+	keys = fill_keys(n, kase, seed);
+	if (!keys)
+		return;
+
+	for (i=0; i<n; ++i)
+		v[i] = DIST_VALUE(keys[i]);
+
+	free(keys);
+}
+
+/*
+ * Switch over the element types, expanding to CALL(suffix) for each.
+ */
+#define ELEM_CASES(CALL)						\
+	case ELEM_U16:		CALL(u16);	break;			\
+	case ELEM_U32:		CALL(u32);	break;			\
+	case ELEM_U64:		CALL(u64);	break;			\
+	case ELEM_FLOAT:	CALL(float);	break;			\
+	case ELEM_DOUBLE:	CALL(double);	break;			\
+	case ELEM_RECORD:	CALL(record);	break;
+
+void sort_fill_elems(void *v, u32 n, SortElem elem, SortCase kase,
+		     u64 seed)
+{
+	u64 *keys;
+
+	keys = fill_keys(n, kase, seed);
+	if (!keys)
+		return;
+
+#define WIDEN_ELEMS(T)	widen_fast_##T(v, keys, n)
+	switch (elem) {
+	ELEM_CASES(WIDEN_ELEMS)
+	default:
+		log_fixme("unknown element type: #%d", elem);
+	}
+#undef WIDEN_ELEMS
+
+	free(keys);
+}
+
+/*
+ * Runs counted into `stats' or watched are performed by the instrumented
+ * kernels.
+ */
+#ifdef NO_SORT_STATS
+# define INSTRUMENTED(STATS)	(watch != NULL)
+#else
+# define INSTRUMENTED(STATS)	((STATS) || watch)
+#endif
+
+/*
+ * Get ready for a run, counting it if `stats' is not a NULL pointer.
+ */
+static void sort_prepare(SortStats *stats)
+{
+	if (stats)
+		memset(counters, 0, sizeof(counters));
+
+	if (!nthreads)
+		sort_set_threads(sort_get_threads());
+}
+
+/*
+ * Check `algo' and get ready for a run.
+ */
+static int sort_begin(SortType algo, SortStats *stats)
+{
+	if (algo < 0 || algo >= SORT_TYPE_COUNT) {
+		log_fixme("wrong algo number: #%d", algo);
+		return -1;
+	}
+
+	sort_prepare(stats);
+
+	return 0;
+}
+
+/*
+ * Sum the counters of every worker into `stats'.
+ */
+static void sort_end(SortStats *stats)
+{
+	u32 i;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for (i=0; i<SCHED_MAX_THREADS; ++i) {
+		stats->cmps += counters[i].stats.cmps;
+		stats->swaps += counters[i].stats.swaps;
+		stats->moves += counters[i].stats.moves;
+		stats->reads += counters[i].stats.reads;
+	}
+}
+
+void sort_run(u16 *v, u32 n, SortType algo, Trace *trace, SortStats *stats)
+{
+	if (!trace) {
+		sort_run_elems(v, n, ELEM_U16, algo, stats);
+		return;
+	}
+
+	if (sort_begin(algo, stats) != 0)
+		return;
+
+	tracer = trace;
+	tracer_worker = 0;
+	sort_funcs_traced_u16[algo](v, n);
+
+	if (stats)
+		sort_end(stats);
+}
+
+/*
+ * Stable mode run of an unstable algorithm: sort the permutation, then
+ * gather the records through it.
+ */
+static void sort_run_stable(SortRecord *v, u32 n, SortType algo,
+			    SortStats *stats)
+{
+	SortRecord *tmp;
+	u32 *perm, i;
+
+	perm = malloc(n * sizeof(u32));
+	tmp = malloc(n * sizeof(SortRecord));
+	if (!perm || !tmp) {
+		log_err("stable sort: could not allocate %u elements", n);
+	}
+	else if (sort_argsort(v, n, ELEM_RECORD, algo, perm, stats) == 0) {
+		for (i=0; i<n; ++i)
+			tmp[i] = v[perm[i]];
+		memcpy(v, tmp, n * sizeof(SortRecord));
+	}
+
+	free(perm);
+	free(tmp);
+}
+
+void sort_run_elems(void *v, u32 n, SortElem elem, SortType algo,
+		    SortStats *stats)
+{
+	if (sort_begin(algo, stats) != 0)
+		return;
+
+	if (stable && elem == ELEM_RECORD && !sort_algo_is_stable(algo)) {
+		sort_run_stable(v, n, algo, stats);
+		return;
+	}
+
+#define RUN_ELEMS(T)	(INSTRUMENTED(stats)				\
+			 ? sort_funcs_counted_##T[algo](v, n)		\
+			 : sort_funcs_fast_##T[algo](v, n))
+	switch (elem) {
+	ELEM_CASES(RUN_ELEMS)
+	default:
+		log_fixme("unknown element type: #%d", elem);
+		return;
+	}
+#undef RUN_ELEMS
+
+	if (stats)
+		sort_end(stats);
+}
+
+int sort_argsort(const void *v, u32 n, SortElem elem, SortType algo,
+		 u32 *perm, SortStats *stats)
+{
+	SortStats pass;
+	u64 *pairs;
+	u32 i;
+	int half, halves;
+
+	pairs = malloc(n * sizeof(u64));
+	if (!pairs) {
+		log_err("argsort: could not allocate %u elements", n);
+		return -1;
+	}
+
+	if (stats)
+		memset(stats, 0, sizeof(*stats));
+
+	for (i=0; i<n; ++i)
+		perm[i] = i;
+
+	halves = elem == ELEM_U64 || elem == ELEM_DOUBLE ? 2 : 1;
+
+	/* every pass keeps the order of the previous one on equal halves,
+	 * since the index of a pair is its place in that order: */
+	for (half=0; half<halves; ++half) {
+		for (i=0; i<n; ++i)
+			pairs[i] = (sort_elem_key(v, perm[i], elem) >>
+				    32*half & 0xffffffff) << 32 | i;
+
+		sort_run_elems(pairs, n, ELEM_U64, algo, stats ? &pass : NULL);
+
+		for (i=0; i<n; ++i)
+			pairs[i] = perm[(u32)pairs[i]];
+		for (i=0; i<n; ++i)
+			perm[i] = pairs[i];
+
+		if (stats) {
+			stats->cmps += pass.cmps;
+			stats->swaps += pass.swaps;
+			stats->moves += pass.moves;
+			stats->reads += pass.reads;
+		}
+	}
+
+	free(pairs);
+
+	return 0;
+}
+
+void sort_select(void *v, u32 n, SortElem elem, u32 k, SortStats *stats)
+{
+	if (k >= n) {
+		log_err("select: rank %u out of %u elements", k, n);
+		return;
+	}
+
+	sort_prepare(stats);
+
+#ifdef NO_SORT_STATS
+# define SELECT_ELEMS(T)	select_fast_##T(v, n, k)
+#else
+# define SELECT_ELEMS(T)	(stats ? select_counted_##T(v, n, k)		\
+				       : select_fast_##T(v, n, k))
+#endif
+	switch (elem) {
+	ELEM_CASES(SELECT_ELEMS)
+	default:
+		log_fixme("unknown element type: #%d", elem);
+		return;
+	}
+#undef SELECT_ELEMS
+
+	if (stats)
+		sort_end(stats);
+}
+
+void sort_partial(void *v, u32 n, SortElem elem, u32 k, SortType algo,
+		  SortStats *stats)
+{
+	if (k > n) {
+		log_err("partial sort: %u out of %u elements", k, n);
+		return;
+	}
+
+	if (sort_begin(algo, stats) != 0)
+		return;
+
+#define PARTIAL_ELEMS(T)	(INSTRUMENTED(stats)				\
+			 ? partial_sort_counted_##T(v, n, k, algo)	\
+			 : partial_sort_fast_##T(v, n, k, algo))
+	switch (elem) {
+	ELEM_CASES(PARTIAL_ELEMS)
+	default:
+		log_fixme("unknown element type: #%d", elem);
+		return;
+	}
+#undef PARTIAL_ELEMS
+
+	if (stats)
+		sort_end(stats);
+}
+
+void sort_run_partial(u16 *v, u32 n, u32 k, SortType algo, Trace *trace,
+		      SortStats *stats)
+{
+	if (!trace) {
+		sort_partial(v, n, ELEM_U16, k, algo, stats);
+		return;
+	}
+
+	if (k > n) {
+		log_err("partial sort: %u out of %u elements", k, n);
+		return;
+	}
+
+	if (sort_begin(algo, stats) != 0)
+		return;
+
+	tracer = trace;
+	tracer_worker = 0;
+	partial_sort_traced_u16(v, n, k, algo);
+
+	if (stats)
+		sort_end(stats);
+}
+
+u32 sort_merge(void *v, u32 n, const void *b, u32 m, SortElem elem,
+	       SortStats *stats)
+{
+	u32 moved = 0;
+
+	sort_prepare(stats);
+
+#ifdef NO_SORT_STATS
+# define MERGE_ELEMS(T)	moved = merge_batch_fast_##T(v, n, b, m)
+#else
+# define MERGE_ELEMS(T)	moved = stats ? merge_batch_counted_##T(v, n, b, m) \
+				      : merge_batch_fast_##T(v, n, b, m)
+#endif
+	switch (elem) {
+	ELEM_CASES(MERGE_ELEMS)
+	default:
+		log_fixme("unknown element type: #%d", elem);
+		return 0;
+	}
+#undef MERGE_ELEMS
+
+	if (stats)
+		sort_end(stats);
+
+	return moved;
+}
+
+SortTopK *sort_topk_new(u32 k, SortElem elem)
+{
+	SortTopK *self;
+
+	if (!k || k > INT_MAX || !sort_elem_size(elem)) {
+		log_err("top-k: invalid k %u or element type #%d", k, elem);
+		return NULL;
+	}
+
+	self = calloc(1, sizeof(SortTopK));
+	if (!self)
+		return NULL;
+
+	self->heap = malloc((size_t)k * sort_elem_size(elem));
+	if (!self->heap) {
+		log_err("top-k: could not allocate %u elements", k);
+		free(self);
+		return NULL;
+	}
+
+	self->elem = elem;
+	self->k = k;
+
+	return self;
+}
+
+void sort_topk_free(SortTopK *self)
+{
+	if (!self)
+		return;
+
+	free(self->heap);
+	free(self);
+}
+
+void sort_topk_push(SortTopK *self, const void *v, u32 n, SortStats *stats)
+{
+	sort_prepare(stats);
+
+#ifdef NO_SORT_STATS
+# define TOPK_PUSH(T)	topk_push_fast_##T(self->heap, &self->size,	\
+					   self->k, v, n)
+#else
+# define TOPK_PUSH(T)	(stats ? topk_push_counted_##T(self->heap,	\
+						       &self->size,	\
+						       self->k, v, n)	\
+			       : topk_push_fast_##T(self->heap, &self->size, \
+						    self->k, v, n))
+#endif
+	switch (self->elem) {
+	ELEM_CASES(TOPK_PUSH)
+	default:
+		log_fixme("unknown element type: #%d", self->elem);
+		return;
+	}
+#undef TOPK_PUSH
+
+	if (stats)
+		sort_end(stats);
+}
+
+u32 sort_topk_get(const SortTopK *self, void *out)
+{
+#define TOPK_GET(T)	topk_get_fast_##T(self->heap, self->size, out)
+	switch (self->elem) {
+	ELEM_CASES(TOPK_GET)
+	default:
+		log_fixme("unknown element type: #%d", self->elem);
+		return 0;
+	}
+#undef TOPK_GET
+
+	return self->size;
+}
+
+INLINE bool sort_algo_is_stable(SortType algo)
+{
+	switch (algo) {
+	case BUBBLE_SORT:
+	case INSERTION_SORT:
+	case MERGE_SORT:
+	case PARALLEL_MERGE_SORT:
+	case COUNTING_SORT:
+	case RADIX_SORT:
+	case TIM_SORT:
+	case AUTO_SORT:
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+INLINE void sort_set_stable(bool enable)
+{
+	stable = enable;
+}
+
+void sort_get_profile(SortProfile *profile)
+{
+	*profile = auto_profile;
+}
+
+INLINE void sort_set_auto_log(bool enable)
+{
+	auto_log = enable;
+}
+
+INLINE void sort_set_watch(SortWatch *w)
+{
+	watch = w;
+}
+
+int sort_set_threads(u32 n)
+{
+	Sched *sched = NULL;
+
+	if (n < 1 || n > SCHED_MAX_THREADS) {
+		log_err("the number of threads must be in 1..%d",
+			SCHED_MAX_THREADS);
+		return -1;
+	}
+
+	if (n == nthreads)
+		return 0;
+
+	/* a single worker needs no scheduler at all: */
+	if (n > 1) {
+		sched = sched_new(n);
+		if (!sched)
+			return -1;
+	}
+
+	sched_free(scheduler);
+	scheduler = sched;
+	nthreads = n;
+
+	return 0;
+}
+
+u32 sort_get_threads(void)
+{
+	long ncpu;
+
+	if (nthreads)
+		return nthreads;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu < 1)
+		return 1;
+
+	return ncpu < SCHED_MAX_THREADS ? ncpu : SCHED_MAX_THREADS;
+}
+
+INLINE void sort_set_leaves(bool enable)
+{
+	leaves = enable;
+}
+
+int sort_set_heap_arity(u8 arity)
+{
+	if (arity != 2 && arity != 4 && arity != 8) {
+		log_err("heap arity must be 2, 4 or 8");
+		return -1;
+	}
+
+	heap_arity = arity;
+
+	return 0;
+}
+
+void sort_heap_push(u16 *heap, u32 n, u8 arity, u16 x)
+{
+	dheap_push_fast_u16(heap, n, arity, x);
+}
+
+u16 sort_heap_pop(u16 *heap, u32 n, u8 arity)
+{
+	return dheap_pop_fast_u16(heap, n, arity);
+}
+
+void sort_quit(void)
+{
+	sched_free(scheduler);
+	scheduler = NULL;
+	nthreads = 0;
+}
+
+bool sort_is_sorted(const u16 *v, u32 n)
+{
+	u32 i;
+
+	for (i=1; i<n; ++i)
+		if (v[i] < v[i-1])
+			return 0;
+
+	return 1;
+}
+
+bool sort_elems_sorted(const void *v, u32 n, SortElem elem)
+{
+	bool sorted = 0;
+
+#define IS_SORTED(T)	sorted = is_sorted_fast_##T(v, n)
+	switch (elem) {
+	ELEM_CASES(IS_SORTED)
+	default:
+		log_fixme("unknown element type: #%d", elem);
+	}
+#undef IS_SORTED
+
+	return sorted;
+}
+
+INLINE size_t sort_elem_size(SortElem elem)
+{
+	if (elem < 0 || elem >= SORT_ELEM_COUNT)
+		return 0;
+
+	return SORT_ELEM_SIZE[elem];
+}
+
+u64 sort_elem_key(const void *v, u32 i, SortElem elem)
+{
+	switch (elem) {
+	case ELEM_U16:
+		return ((const u16 *)v)[i];
+
+	case ELEM_U32:
+		return ((const u32 *)v)[i];
+
+	case ELEM_U64:
+		return ((const u64 *)v)[i];
+
+	case ELEM_FLOAT:
+		return float_key(((const float *)v)[i]);
+
+	case ELEM_DOUBLE:
+		return double_key(((const double *)v)[i]);
+
+	case ELEM_RECORD:
+		return ((const SortRecord *)v)[i].key;
+
+	default:
+		log_fixme("unknown element type: #%d", elem);
+	}
+
+	return 0;
+}
+
+INLINE const char *sort_algo_name(SortType algo)
+{
+	if (algo < 0 || algo >= SORT_TYPE_COUNT)
+		return NULL;
+
+	return SORT_STRALGO[algo];
+}
+
+INLINE const char *sort_case_name(SortCase kase)
+{
+	if (kase < 0 || kase >= SORT_CASE_COUNT)
+		return NULL;
+
+	return SORT_STRCASE[kase];
+}
+
+INLINE const char *sort_elem_name(SortElem elem)
+{
+	if (elem < 0 || elem >= SORT_ELEM_COUNT)
+		return NULL;
+
+	return SORT_STRELEM[elem];
+}
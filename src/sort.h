@@ -0,0 +1,322 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SORT_H
+#define SORT_H
+
+#include "stdinc.h"
+#include "trace.h"
+
+/*
+ * The menu bitmap paints the entries up to HEAP_SORT, in this order:
+ * new algorithms go after it.
+ */
+typedef enum {
+	BUBBLE_SORT,
+	SELECTION_SORT,
+	INSERTION_SORT,
+	QUICK_SORT,
+	HEAP_SORT,
+	BLOCK_QUICK_SORT,
+	VECTOR_QUICK_SORT,
+	PARALLEL_QUICK_SORT,
+	MERGE_SORT,
+	PARALLEL_MERGE_SORT,
+	PARALLEL_SAMPLE_SORT,
+	COUNTING_SORT,
+	RADIX_SORT,
+	INTRO_SORT,
+	DARY_HEAP_SORT,
+	TIM_SORT,
+	AUTO_SORT,		/* one of the above, from a profile of the input */
+
+	SORT_TYPE_COUNT
+} SortType;
+
+typedef enum {
+	CASE_RANDOM,
+	CASE_REVERSED,
+	CASE_NEARLY_SORTED,
+	CASE_FEW_UNIQUE,
+	CASE_ZIPF,
+	CASE_SAWTOOTH,
+	CASE_ORGAN_PIPE,
+	CASE_ALL_EQUAL,
+	CASE_K_SORTED,
+	CASE_SORTED_RUNS,
+
+	SORT_CASE_COUNT
+} SortCase;
+
+/*
+ * Element types of sort_run_elems(): the visual mode sorts u16 values.
+ */
+typedef enum {
+	ELEM_U16,
+	ELEM_U32,
+	ELEM_U64,
+	ELEM_FLOAT,
+	ELEM_DOUBLE,
+	ELEM_RECORD,
+
+	SORT_ELEM_COUNT
+} SortElem;
+
+/*
+ * Key and payload, ordered by key.
+ */
+typedef struct {
+	u32 key;
+	u32 payload;
+} SortRecord;
+
+/*
+ * Operation counters collected by a sort run.
+ */
+typedef struct {
+	u64 cmps;
+	u64 swaps;
+	u64 moves;
+	u64 reads;	/* elements read to be compared or keyed */
+} SortStats;
+
+/*
+ * Watch over the untraced runs (see sort_set_watch()): `v', `n', `elem',
+ * `keys' and `nkeys' are set by the watcher, which sets `wanted' and
+ * `cancel' at any time with atomic stores.
+ */
+typedef struct {
+	const void *v;		/* elements sampled by the snapshots */
+	u32 n;
+	SortElem elem;
+	u64 *keys;		/* snapshot: keys[i] is the key of v[i*n/nkeys] */
+	u32 nkeys;
+	bool wanted;		/* a snapshot is asked for */
+	bool cancel;		/* the run must stop */
+} SortWatch;
+
+/*
+ * Presortedness profile drawn by AUTO_SORT from a sample of the keys, and
+ * the algorithm it chose from it.
+ */
+typedef struct {
+	u32 sample;		/* keys drawn */
+	u64 runs;		/* ascending runs, estimated */
+	double inversions;	/* fraction of the sampled pairs out of order */
+	u64 distinct;		/* distinct keys, estimated */
+	u64 range;		/* greatest minus smallest sampled key */
+	SortType choice;
+	u64 ns;			/* spent drawing the profile and choosing */
+} SortProfile;
+
+/*
+ * Fill `v' with the values on screen (0..DIST_VALUE_MAX-1) of the `n' keys
+ * generated for the case `kase' from `seed' (see dist.h): the same seed
+ * always gives the same values. Big inputs are generated in blocks by the
+ * workers of the parallel algorithms.
+ */
+void sort_fill (u16 *v, u32 n, SortCase kase, u64 seed);
+
+/*
+ * Sort the `n' elements of `v' using `algo' algorithm.
+ *
+ * If `trace' is not a NULL pointer, every step, swap and write performed by
+ * the algorithm is pushed to it, so that the run can be replayed elsewhere
+ * (the call blocks whenever the trace is full). Closing the trace cancels
+ * the run: sort_run() returns early, leaving `v' partially sorted.
+ * If `stats' is not a NULL pointer, the run is performed by the instrumented
+ * kernels and the operation counters are stored there (traced runs are never
+ * instrumented). Building with NO_SORT_STATS defined leaves the counting out
+ * of the instrumented kernels: the counters are then all 0.
+ * With neither, the plain kernels are used, with no accounting at all.
+ *
+ * Parallel algorithms run on the workers set by sort_set_threads(), every
+ * worker of an instrumented run counting on its own. When traced,
+ * TRACE_WORKER and TRACE_RANGE events tell which worker performed the
+ * following operations and on which range it is working.
+ * Run-based algorithms push a TRACE_RUN event for every run they find or
+ * merge.
+ * Only one sort_run() may be in progress at a time.
+ */
+void sort_run (u16 *v, u32 n, SortType algo, Trace *trace, SortStats *stats);
+
+/*
+ * Same as sort_fill(), sort_run() and sort_is_sorted() for `n' elements of
+ * type `elem': sort_fill_elems() draws the same keys as sort_fill(), over
+ * the whole range of `elem' rather than scaled to the screen, and
+ * converted keeping their order (records get their index as payload).
+ * The runs of sort_run_elems() cannot be traced.
+ * Floating point arrays must not hold NaNs.
+ */
+void sort_fill_elems   (void *v, u32 n, SortElem elem, SortCase kase,
+			u64 seed);
+void sort_run_elems    (void *v, u32 n, SortElem elem, SortType algo,
+			SortStats *stats);
+bool sort_elems_sorted (const void *v, u32 n, SortElem elem);
+
+/*
+ * Size in bytes of an element of type `elem' (0 for unknown values).
+ */
+size_t sort_elem_size (SortElem elem);
+
+/*
+ * Key of v[i] as an unsigned integer of the same order as the elements of
+ * type `elem' (0 for unknown types).
+ */
+u64 sort_elem_key (const void *v, u32 i, SortElem elem);
+
+/*
+ * Set the number of workers used by the parallel algorithms (1 up to
+ * SCHED_MAX_THREADS) and return 0, or -1 on error.
+ * The default is the number of online processors.
+ */
+int  sort_set_threads (u32 nthreads);
+u32  sort_get_threads (void);
+
+/*
+ * Sort the small ranges of quick sort and the runs of merge sort by
+ * sorting networks (`enable' = 1, the default), or by plain recursion and
+ * insertion (`enable' = 0).
+ * The plain kernels use SIMD networks where the CPU has SSE2.
+ */
+void sort_set_leaves (bool enable);
+
+/*
+ * Return 1 if `algo' keeps equal elements in their order.
+ */
+bool sort_algo_is_stable (SortType algo);
+
+/*
+ * Stable mode (`enable' = 1; off by default): sort_run_elems() makes the
+ * unstable algorithms stable, running them on the (key, index) pairs of
+ * sort_argsort() and moving the elements into place. Only records, whose
+ * payload tells equal keys apart, are affected.
+ */
+void sort_set_stable (bool enable);
+
+/*
+ * Watched runs: while `watch' is set (NULL by default), sort_run_elems() and
+ * sort_partial() run the instrumented kernels, which look at it at the safe
+ * points where a traced run looks at its trace. Once watch->cancel is set
+ * the run returns early, leaving the elements partially sorted.
+ * Once watch->wanted is set, the first safe point where no parallel task
+ * is running stores the keys sampled from watch->v in watch->keys and
+ * clears it (with release semantics): the watcher may read the keys only
+ * while it is clear. The sort thread alone reads the elements.
+ */
+void sort_set_watch (SortWatch *watch);
+
+/*
+ * Profile of the input of the last AUTO_SORT run, in `profile'.
+ * Every run logs it as well, unless sort_set_auto_log(0) was called.
+ */
+void sort_get_profile  (SortProfile *profile);
+void sort_set_auto_log (bool enable);
+
+/*
+ * Store in `perm' the permutation sorting the `n' elements of `v', which
+ * are left as they are: v[perm[0]], v[perm[1]]... are in order, and equal
+ * keys keep the order of their indices, whatever `algo'.
+ * `algo' sorts 64-bit pairs of a 32-bit key and an index, so that no two
+ * are equal; keys wider than 32 bits are sorted in two passes, lower half
+ * first. If `stats' is not a NULL pointer the operations of the passes are
+ * counted there.
+ * Return 0, or -1 on error.
+ */
+int sort_argsort (const void *v, u32 n, SortElem elem, SortType algo,
+		  u32 *perm, SortStats *stats);
+
+/*
+ * Selection. sort_select() moves the element of rank `k' (from 0, below
+ * `n') to v[k], the elements not greater than it before and the others
+ * after, in linear time: quickselect with the pivots of intro sort, falling
+ * back to medians of medians once they degenerate.
+ * sort_partial() leaves the `k' (up to `n') smallest elements sorted by
+ * `algo' in v[0..k), and the others in no order after them.
+ * sort_run_partial() is sort_partial() on u16 elements, which may be
+ * traced and cancelled as by sort_run().
+ * If `stats' is not a NULL pointer the operations are counted there.
+ */
+void sort_select      (void *v, u32 n, SortElem elem, u32 k,
+		       SortStats *stats);
+void sort_partial     (void *v, u32 n, SortElem elem, u32 k, SortType algo,
+		       SortStats *stats);
+void sort_run_partial (u16 *v, u32 n, u32 k, SortType algo, Trace *trace,
+		       SortStats *stats);
+
+/*
+ * Streaming top-k: the `k' smallest of the elements of type `elem' pushed
+ * so far, held by a bounded max-heap laid out as by DARY_HEAP_SORT.
+ * sort_topk_push() offers the `n' elements of `v', which are not kept; if
+ * `stats' is not a NULL pointer the operations of the call are counted
+ * there. sort_topk_get() stores them in order in `out' (room for `k'
+ * elements) and returns how many there are, fewer than `k' as long as
+ * fewer were pushed.
+ * On error sort_topk_new() returns a NULL pointer.
+ */
+typedef struct _SortTopK SortTopK;
+
+SortTopK *sort_topk_new  (u32 k, SortElem elem);
+void      sort_topk_free (SortTopK *self);
+void      sort_topk_push (SortTopK *self, const void *v, u32 n,
+			  SortStats *stats);
+u32       sort_topk_get  (const SortTopK *self, void *out);
+
+/*
+ * Merge the `m' sorted elements of `b' into the `n' sorted elements of
+ * `v', which must have room for n+m, keeping equal elements of `v' first,
+ * and return how many elements of `v' were moved to make room: those
+ * smaller than every element of `b' stay where they are.
+ * If `stats' is not a NULL pointer the operations are counted there.
+ */
+u32 sort_merge (void *v, u32 n, const void *b, u32 m, SortElem elem,
+		SortStats *stats);
+
+/*
+ * Set the arity of the heap used by DARY_HEAP_SORT: 2, 4 (the default) or
+ * 8. Return 0, or -1 if `arity' is not supported.
+ */
+int sort_set_heap_arity (u8 arity);
+
+/*
+ * Priority queue over the layout of DARY_HEAP_SORT, a max-heap of `arity'
+ * children per node held in `heap'.
+ * sort_heap_push() adds `x' to a heap of `n' elements (`heap' must have
+ * room for n+1); sort_heap_pop() removes and returns the greatest of the
+ * `n' (at least 1) elements.
+ */
+void sort_heap_push (u16 *heap, u32 n, u8 arity, u16 x);
+u16  sort_heap_pop  (u16 *heap, u32 n, u8 arity);
+
+/*
+ * Release the workers of the parallel algorithms.
+ */
+void sort_quit (void);
+
+/*
+ * Return 1 if `v' is in non-decreasing order, 0 otherwise.
+ */
+bool sort_is_sorted (const u16 *v, u32 n);
+
+/*
+ * Human readable names (NULL for unknown values).
+ */
+const char *sort_algo_name (SortType algo);
+const char *sort_case_name (SortCase kase);
+const char *sort_elem_name (SortElem elem);
+
+#endif /* !SORT_H */
@@ -0,0 +1,182 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Element types of the sort kernels.
+ *
+ * This file is included by sort.c once per kernel variant, after the
+ * variant macros: it instantiates sort_kernel.h for every SortElem.
+ * If SORT_ELEMS_U16_ONLY is defined only the u16 kernels are built, and if
+ * VECTOR_KERNELS is defined the u16 kernels use the SIMD merge and network
+ * where the CPU has SSE2, and the unsigned kernels the vector partition of
+ * vpart.h, picked at run time.
+ *
+ * Every type takes the top bits of the full-range keys drawn by
+ * sort_fill_elems() that it has room for, so that they sort the same
+ * sequence (ties apart) and only the width of the elements changes;
+ * floating point values get the finite value of the same rank, of either
+ * sign and any magnitude.
+ */
+
+#ifndef _SORT_INSIDE
+# error "Only "sort.h" can be included."
+#endif
+
+#define ELEM		u16
+#define KT(NAME)	NAME##_u16
+#define ELEM_LESS(A, B)	((A) < (B))
+#define KEY_T		u16
+#define KEY(X)		(X)
+#define FROM_KEY(K)	((u16)(K))
+#define WIDEN(V, I, X)	((V)[I] = (X) >> 48)
+#define KEYS_ONLY	1
+#if defined(VECTOR_KERNELS) && defined(__SSE2__)
+# define MERGE_VECTOR(SRC, DST, I, M, J, R, K, END)			\
+	merge_vector(SRC, DST, I, M, J, R, K, END)
+# define NETWORK_VECTOR(V, N)	network_vector(V, N)
+#endif
+#ifdef VECTOR_KERNELS
+# define PARTITION_VECTOR(V, N, PIVOT, LE)	vpart_u16(V, N, PIVOT, LE)
+#endif
+
+#include "sort_kernel.h"
+
+#undef ELEM
+#undef KT
+#undef ELEM_LESS
+#undef KEY_T
+#undef KEY
+#undef FROM_KEY
+#undef WIDEN
+#undef KEYS_ONLY
+#undef MERGE_VECTOR
+#undef NETWORK_VECTOR
+#undef PARTITION_VECTOR
+
+#ifndef SORT_ELEMS_U16_ONLY
+
+#define ELEM		u32
+#define KT(NAME)	NAME##_u32
+#define ELEM_LESS(A, B)	((A) < (B))
+#define KEY_T		u32
+#define KEY(X)		(X)
+#define FROM_KEY(K)	((u32)(K))
+#define WIDEN(V, I, X)	((V)[I] = (X) >> 32)
+#define KEYS_ONLY	1
+#ifdef VECTOR_KERNELS
+# define PARTITION_VECTOR(V, N, PIVOT, LE)	vpart_u32(V, N, PIVOT, LE)
+#endif
+
+#include "sort_kernel.h"
+
+#undef ELEM
+#undef KT
+#undef ELEM_LESS
+#undef KEY_T
+#undef KEY
+#undef FROM_KEY
+#undef WIDEN
+#undef KEYS_ONLY
+#undef PARTITION_VECTOR
+
+#define ELEM		u64
+#define KT(NAME)	NAME##_u64
+#define ELEM_LESS(A, B)	((A) < (B))
+#define KEY_T		u64
+#define KEY(X)		(X)
+#define FROM_KEY(K)	((u64)(K))
+#define WIDEN(V, I, X)	((V)[I] = (X))
+#define KEYS_ONLY	1
+#ifdef VECTOR_KERNELS
+# define PARTITION_VECTOR(V, N, PIVOT, LE)	vpart_u64(V, N, PIVOT, LE)
+#endif
+
+#include "sort_kernel.h"
+
+#undef ELEM
+#undef KT
+#undef ELEM_LESS
+#undef KEY_T
+#undef KEY
+#undef FROM_KEY
+#undef WIDEN
+#undef KEYS_ONLY
+#undef PARTITION_VECTOR
+
+/* floating point keys are compared natively (no NaNs) and normalised into
+ * unsigned integers of the same order for counting and radix sort; -0 and
+ * +0 compare equal, so they are not keys alone: */
+#define ELEM		float
+#define KT(NAME)	NAME##_float
+#define ELEM_LESS(A, B)	((A) < (B))
+#define KEY_T		u32
+#define KEY(X)		float_key(X)
+#define FROM_KEY(K)	float_of_key(K)
+#define WIDEN(V, I, X)	((V)[I] = float_of_fill(X))
+#define KEYS_ONLY	0
+
+#include "sort_kernel.h"
+
+#undef ELEM
+#undef KT
+#undef ELEM_LESS
+#undef KEY_T
+#undef KEY
+#undef FROM_KEY
+#undef WIDEN
+#undef KEYS_ONLY
+
+#define ELEM		double
+#define KT(NAME)	NAME##_double
+#define ELEM_LESS(A, B)	((A) < (B))
+#define KEY_T		u64
+#define KEY(X)		double_key(X)
+#define FROM_KEY(K)	double_of_key(K)
+#define WIDEN(V, I, X)	((V)[I] = double_of_fill(X))
+#define KEYS_ONLY	0
+
+#include "sort_kernel.h"
+
+#undef ELEM
+#undef KT
+#undef ELEM_LESS
+#undef KEY_T
+#undef KEY
+#undef FROM_KEY
+#undef WIDEN
+#undef KEYS_ONLY
+
+/* records carry their original position as payload: */
+#define ELEM		SortRecord
+#define KT(NAME)	NAME##_record
+#define ELEM_LESS(A, B)	((A).key < (B).key)
+#define KEY_T		u32
+#define KEY(X)		((X).key)
+#define WIDEN(V, I, X)	((V)[I].key = (X) >> 32, (V)[I].payload = (I))
+#define KEYS_ONLY	0
+
+#include "sort_kernel.h"
+
+#undef ELEM
+#undef KT
+#undef ELEM_LESS
+#undef KEY_T
+#undef KEY
+#undef WIDEN
+#undef KEYS_ONLY
+
+#endif /* !SORT_ELEMS_U16_ONLY */
@@ -0,0 +1,2299 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Sort kernels template.
+ *
+ * This file is included several times by sort.c, once per kernel variant
+ * and element type (see sort_elems.h).
+ * Before including it, the following macros must be defined:
+ *
+ *  ELEM	   - the element type;
+ *  ELEM_LESS(A, B) - order of two elements, by key;
+ *  KEY_T	   - unsigned integer type of the keys;
+ *  KEY(X)	   - key of the element X, in the same order as ELEM_LESS();
+ *  FROM_KEY(K)	   - element of key K, only where elements are keys alone;
+ *  WIDEN(V, I, X) - set V[I] to the element of the full-range u64 key X
+ *		     drawn by sort_fill_elems(), keeping the order of the
+ *		     keys;
+ *  KEYS_ONLY	   - 1 if equal elements cannot be told apart (they are
+ *		     their keys alone), so that the stable kernels may use
+ *		     the unstable network leaves; 0 otherwise;
+ *  K(NAME)	   - mangle NAME into the variant and type specific name;
+ *  STEP(V, I, J)  - executed once per elementary step of the algorithm,
+ *		     while it is looking at V[I] and V[J];
+ *  LESS(A, B)	   - compare two values, ELEM_LESS(A, B);
+ *  SWAP(V, I, J)  - swap V[I] with V[J], by K(swap);
+ *  MOVE(V, I, X)  - store the value X in V[I];
+ *  READ_KEY(X)	   - KEY(X) of the element X, read from the array by the
+ *		     kernels that do not compare;
+ *  SCRATCH(V, I, X) - store the value X in V[I] of a scratch buffer;
+ *  CANCELLED()	   - true if the run must stop as soon as possible: it is
+ *		     checked at safe points, where the array still holds a
+ *		     permutation of its input (between swaps, partitions,
+ *		     merges and passes, never in the middle of a pass
+ *		     writing it), and the kernels simply return leaving the
+ *		     data partially sorted;
+ *  RANGE(V, L, R) - the calling worker now works on V[L..R] (L > R when
+ *		     it is done);
+ *  RUN(F, V, L, R)   - run the task F on V[L..R] and every task it spawns,
+ *			returning when all of them are done;
+ *  SPAWN(F, V, L, R) - spawn the task F on V[L..R], from inside a task;
+ *  SPAWN_CUTOFF   - ranges smaller than this are not split among workers;
+ *  MARK_RUN(V, L, R) - V[L..R] is now a sorted run.
+ *
+ * MERGE_VECTOR(SRC, DST, I, M, J, R, K, END) and NETWORK_VECTOR(V, N) may be
+ * defined to replace the bodies of merge() and network_sort(), and
+ * PARTITION_VECTOR(V, N, PIVOT, LE) to try a vpart.h partition before
+ * split() (it evaluates to -1 where it cannot run).
+ * If BUCKETS_IN_PLACE is defined the buckets of the sample sort are moved
+ * back to V before they are sorted, so that the steps sorting them are
+ * taken on V.
+ */
+
+#ifndef _SORT_INSIDE
+# error "Only "sort.h" can be included."
+#endif
+
+typedef void (* K(SortFunc))(ELEM *, int);
+
+INLINE static void K(swap)(ELEM *a, ELEM *b)
+{
+	ELEM t = *a;
+
+	*a = *b;
+	*b = t;
+}
+
+static int K(select_min)(ELEM *a, int start, int end)
+{
+	int i, imin;
+
+	imin = start;
+
+	for (i=start+1; i<=end; ++i) {
+		STEP(a, i, imin);
+		if (LESS(a[i], a[imin]))
+			imin = i;
+	}
+
+	return imin;
+}
+
+static int K(partition)(ELEM *v, int l, int r)
+{
+	int p, i, j;
+
+	p = (l+r)/2;
+	SWAP(v, p, r);
+	j = l;
+
+	for (i=l; i<r && !CANCELLED(); ++i) {
+		STEP(v, i, r);
+		if (!LESS(v[r], v[i])) {
+			SWAP(v, i, j);
+			++j;
+		}
+	}
+
+	SWAP(v, j, r);
+	
+	return j;
+}
+
+/*
+ * Sorting network for the `n' (up to NETWORK_MAX) elements from v[l]:
+ * Batcher's odd-even merge sort, cut to size.
+ */
+static void K(network_sort)(ELEM *v, int l, int n)
+{
+#ifdef NETWORK_VECTOR
+	NETWORK_VECTOR(v + l, n);
+#else
+	int p, k, j, i, a;
+
+	for (p=1; p<n; p*=2) {
+		for (k=p; k>=1; k/=2) {
+			for (j=k%p; j+k<n; j+=2*k) {
+				for (i=0; i<k && i<n-j-k; ++i) {
+					if ((i+j) / (2*p) != (i+j+k) / (2*p))
+						continue;
+
+					a = l + i + j;
+					STEP(v, a, a+k);
+					if (LESS(v[a+k], v[a]))
+						SWAP(v, a, a+k);
+				}
+			}
+		}
+	}
+#endif
+}
+
+static void K(_quick_sort)(ELEM *v, int l, int r)
+{
+	int p;
+
+	/* recurse into the smaller side, so that the stack stays logarithmic
+	 * even when the partitions degenerate (e.g. on equal keys): */
+	while (l < r && !CANCELLED()) {
+		if (leaves && r - l < NETWORK_MAX) {
+			K(network_sort)(v, l, r - l + 1);
+			return;
+		}
+
+		p = K(partition)(v, l, r);
+		if (p - l < r - p) {
+			K(_quick_sort)(v, l, p-1);
+			l = p + 1;
+		}
+		else {
+			K(_quick_sort)(v, p+1, r);
+			r = p - 1;
+		}
+	}
+}
+
+static void K(sort3)(ELEM *v, int a, int b, int c)
+{
+	STEP(v, a, c);
+
+	if (LESS(v[b], v[a]))
+		SWAP(v, a, b);
+
+	if (LESS(v[c], v[b])) {
+		SWAP(v, b, c);
+		if (LESS(v[b], v[a]))
+			SWAP(v, a, b);
+	}
+}
+
+/*
+ * Move the pivot of v[begin..end) to v[begin]: the median of the first,
+ * middle and last keys, or of three such medians (the ninther) on ranges
+ * of more than INTRO_NINTHER elements. A key of v[end-3..end-1] is left
+ * not less than it, which bounds the unguarded scans of partition_right().
+ */
+static void K(choose_pivot)(ELEM *v, int begin, int end)
+{
+	int s2 = (end - begin) / 2;
+
+	if (end - begin > INTRO_NINTHER) {
+		K(sort3)(v, begin, begin+s2, end-1);
+		K(sort3)(v, begin+1, begin+s2-1, end-2);
+		K(sort3)(v, begin+2, begin+s2+1, end-3);
+		K(sort3)(v, begin+s2-1, begin+s2, begin+s2+1);
+		SWAP(v, begin, begin+s2);
+	}
+	else {
+		K(sort3)(v, begin+s2, begin, end-1);
+	}
+}
+
+/*
+ * BlockQuicksort partition (Edelkamp and Weiss): the pivot is chosen as by
+ * intro sort and moved to v[r]. Blocks of PARTITION_BLOCK elements are
+ * scanned from both ends, storing the offsets of the elements on the wrong
+ * side without branching on the comparisons, then the misplaced elements
+ * of both sides are swapped pairwise. What is left when less than two
+ * blocks remain is partitioned as in K(partition).
+ *
+ * Keys equal to the pivot go to either side, so that runs of equal keys
+ * are split evenly.
+ */
+static int K(block_partition)(ELEM *v, int l, int r)
+{
+	u8 offl[PARTITION_BLOCK], offr[PARTITION_BLOCK];
+	int first, last, nl, nr, sl, sr, i, m;
+	ELEM pivot;
+
+	K(choose_pivot)(v, l, r+1);
+	SWAP(v, l, r);
+	pivot = v[r];
+
+	/* v[l..first-1] <= pivot <= v[last..r-1]: */
+	first = l;
+	last = r;
+	nl = nr = sl = sr = 0;
+
+	while (last - first > 2*PARTITION_BLOCK && !CANCELLED()) {
+		if (!nl) {
+			sl = 0;
+			for (i=0; i<PARTITION_BLOCK; ++i) {
+				STEP(v, first+i, r);
+				offl[nl] = i;
+				nl += !LESS(v[first+i], pivot);
+			}
+		}
+
+		if (!nr) {
+			sr = 0;
+			for (i=0; i<PARTITION_BLOCK; ++i) {
+				STEP(v, last-1-i, r);
+				offr[nr] = i;
+				nr += !LESS(pivot, v[last-1-i]);
+			}
+		}
+
+		m = nl < nr ? nl : nr;
+		for (i=0; i<m; ++i)
+			SWAP(v, first + offl[sl+i], last-1 - offr[sr+i]);
+
+		nl -= m;
+		nr -= m;
+		sl += m;
+		sr += m;
+
+		/* a block is done when all its misplaced elements are: */
+		if (!nl)
+			first += PARTITION_BLOCK;
+		if (!nr)
+			last -= PARTITION_BLOCK;
+	}
+
+	for (i=first; i<last && !CANCELLED(); ++i) {
+		STEP(v, i, r);
+		if (!LESS(v[r], v[i])) {
+			SWAP(v, i, first);
+			++first;
+		}
+	}
+
+	SWAP(v, first, r);
+
+	return first;
+}
+
+static void K(_block_quick_sort)(ELEM *v, int l, int r)
+{
+	int p;
+
+	while (l < r && !CANCELLED()) {
+		if (leaves && r - l < NETWORK_MAX) {
+			K(network_sort)(v, l, r - l + 1);
+			return;
+		}
+
+		p = K(block_partition)(v, l, r);
+		if (p - l < r - p) {
+			K(_block_quick_sort)(v, l, p-1);
+			l = p + 1;
+		}
+		else {
+			K(_block_quick_sort)(v, p+1, r);
+			r = p - 1;
+		}
+	}
+}
+
+/*
+ * Move the elements of v[l..r-1] less than v[r] (not greater than it if
+ * `le') to the front, and return how many they are.
+ */
+static int K(split)(ELEM *v, int l, int r, bool le)
+{
+	int i, j;
+
+	for (i=l, j=l; i<r && !CANCELLED(); ++i) {
+		STEP(v, i, r);
+		if (le ? !LESS(v[r], v[i]) : LESS(v[i], v[r])) {
+			SWAP(v, i, j);
+			++j;
+		}
+	}
+
+	return j - l;
+}
+
+/*
+ * Vector quick sort: the pivot is chosen as by intro sort and moved to
+ * v[r], and the partition is PARTITION_VECTOR() where the kernel has one
+ * and the CPU can run it.
+ * Keys equal to the pivot go right; but if the range is `bounded', i.e.
+ * v[l-1] is the pivot of an enclosing partition and no key of the range is
+ * smaller, and it equals the new pivot, the keys not greater than the
+ * pivot go left instead, where they are all equal and already in place.
+ */
+static void K(_vector_quick_sort)(ELEM *v, int l, int r, bool bounded)
+{
+	int p, lsize, rsize;
+	bool le;
+
+	while (l < r && !CANCELLED()) {
+		if (leaves && r - l < NETWORK_MAX) {
+			K(network_sort)(v, l, r - l + 1);
+			return;
+		}
+
+		K(choose_pivot)(v, l, r+1);
+		SWAP(v, l, r);
+
+		le = 0;
+		if (bounded) {
+			STEP(v, l-1, r);
+			le = !LESS(v[l-1], v[r]);
+		}
+
+#ifdef PARTITION_VECTOR
+		p = PARTITION_VECTOR(v + l, r - l, v[r], le);
+		if (p < 0)
+#endif
+			p = K(split)(v, l, r, le);
+
+		p += l;
+		SWAP(v, p, r);
+
+		if (le) {
+			l = p + 1;
+			continue;
+		}
+
+		/* unbalanced: break the pattern which caused it, as intro
+		 * sort does (the scalar split keeps the order of the keys
+		 * less than the pivot, and so the pattern) */
+		lsize = p - l;
+		rsize = r - p;
+		if (lsize < (r-l+1) / 8 || rsize < (r-l+1) / 8) {
+			if (lsize >= INTRO_INSERTION) {
+				SWAP(v, l, l + lsize/4);
+				SWAP(v, p-1, p - lsize/4);
+			}
+
+			if (rsize >= INTRO_INSERTION) {
+				SWAP(v, p+1, p+1 + rsize/4);
+				SWAP(v, r, r+1 - rsize/4);
+			}
+		}
+
+		if (lsize < rsize) {
+			K(_vector_quick_sort)(v, l, p-1, bounded);
+			l = p + 1;
+			bounded = 1;
+		}
+		else {
+			K(_vector_quick_sort)(v, p+1, r, 1);
+			r = p - 1;
+		}
+	}
+}
+
+static void K(heapify)(ELEM *v, int i, int max)
+{
+	int l, r, gr = i;
+
+	l = i * 2 + 1;
+	r = i * 2 + 2;
+
+	STEP(v, i, l < max ? l : i);
+
+	if (l < max && LESS(v[gr], v[l]))
+		gr = l;
+
+	if (r < max && LESS(v[gr], v[r]))
+		gr = r;
+
+	if (gr != i) {
+		SWAP(v, gr, i);
+		K(heapify)(v, gr, max);
+	}
+}
+
+static void K(bubble_sort)(ELEM *v, int n)
+{
+	int i, j;
+	bool swapped;
+
+	swapped = 1;
+	for (i=0; swapped && i<n && !CANCELLED(); ++i) {
+		swapped = 0;
+		for (j=0; j<n-1; ++j) {
+			STEP(v, j, j+1);
+			if (LESS(v[j+1], v[j])) {
+				SWAP(v, j, j+1);
+				swapped = 1;
+			}
+		}
+	}
+}
+
+static void K(selection_sort)(ELEM *v, int n)
+{
+	int i, imin;
+
+	for (i=0; i<n && !CANCELLED(); ++i) {
+		imin = K(select_min)(v, i, n-1);
+		if (imin != i)
+			SWAP(v, i, imin);
+	}
+}
+
+static void K(_insertion_sort)(ELEM *v, int l, int r)
+{
+	int i, j;
+	ELEM value;
+
+	for (i=l+1; i<=r && !CANCELLED(); ++i) {
+		j = i - 1;
+		value = v[i];
+		
+		while (j>=l && LESS(value, v[j])) {
+			STEP(v, j, j+1);
+			MOVE(v, j+1, v[j]);
+			--j;
+		} 
+
+		MOVE(v, j+1, value);
+	}
+}
+
+/*
+ * Introsort, pattern-defeating flavour: median of 3 (ninther on large
+ * ranges) pivot, Hoare-style partition, small ranges left to insertion
+ * sort (or to the network leaves), heap sort once the depth budget of
+ * 2*log2(n) partitions is over. Ranges found already partitioned are
+ * finished by a bounded insertion sort, and runs of keys equal to the
+ * pivot are split off in linear time.
+ */
+static void K(sift_down)(ELEM *v, int base, int i, int n)
+{
+	int c;
+
+	for (c=2*i+1; c<n; i=c, c=2*i+1) {
+		if (c+1 < n && LESS(v[base+c], v[base+c+1]))
+			++c;
+
+		if (!LESS(v[base+i], v[base+c]))
+			break;
+
+		SWAP(v, base+i, base+c);
+	}
+}
+
+static void K(heap_range)(ELEM *v, int begin, int end)
+{
+	int i, n = end - begin;
+
+	for (i=n/2-1; i>=0 && !CANCELLED(); --i)
+		K(sift_down)(v, begin, i, n);
+
+	for (i=n-1; i>0 && !CANCELLED(); --i) {
+		SWAP(v, begin, begin+i);
+		K(sift_down)(v, begin, 0, i);
+	}
+}
+
+/*
+ * Partition v[begin..end) around the pivot v[begin], keys equal to the
+ * pivot going right, and return its final position. `partitioned' is set
+ * if no key had to be moved.
+ */
+static int K(partition_right)(ELEM *v, int begin, int end, bool *partitioned)
+{
+	ELEM pivot = v[begin];
+	int first = begin, last = end;
+
+	while (LESS(v[++first], pivot))
+		;
+
+	if (first - 1 == begin)
+		while (first < last && !LESS(v[--last], pivot))
+			;
+	else
+		while (!LESS(v[--last], pivot))
+			;
+
+	*partitioned = first >= last;
+
+	while (first < last && !CANCELLED()) {
+		STEP(v, first, last);
+		SWAP(v, first, last);
+
+		while (LESS(v[++first], pivot))
+			;
+		while (!LESS(v[--last], pivot))
+			;
+	}
+
+	SWAP(v, begin, first - 1);
+
+	return first - 1;
+}
+
+/*
+ * Same, but keys equal to the pivot go left: used when the pivot equals
+ * the key before the range, so that the whole left part is made of keys
+ * equal to it.
+ */
+static int K(partition_left)(ELEM *v, int begin, int end)
+{
+	ELEM pivot = v[begin];
+	int first = begin, last = end;
+
+	while (LESS(pivot, v[--last]))
+		;
+
+	if (last + 1 == end)
+		while (first < last && !LESS(pivot, v[++first]))
+			;
+	else
+		while (!LESS(pivot, v[++first]))
+			;
+
+	while (first < last && !CANCELLED()) {
+		STEP(v, first, last);
+		SWAP(v, first, last);
+
+		while (LESS(pivot, v[--last]))
+			;
+		while (!LESS(pivot, v[++first]))
+			;
+	}
+
+	SWAP(v, begin, last);
+
+	return last;
+}
+
+/*
+ * Insertion sort giving up (and returning 0) after INTRO_PARTIAL moves.
+ */
+static bool K(partial_insertion)(ELEM *v, int begin, int end)
+{
+	int cur, sift, moves;
+	ELEM x;
+
+	for (moves=0, cur=begin+1; cur<end; ++cur) {
+		if (moves > INTRO_PARTIAL)
+			return 0;
+
+		sift = cur;
+		if (!LESS(v[sift], v[sift-1]))
+			continue;
+
+		x = v[sift];
+		do {
+			STEP(v, sift-1, sift);
+			MOVE(v, sift, v[sift-1]);
+			--sift;
+		} while (sift != begin && LESS(x, v[sift-1]));
+
+		MOVE(v, sift, x);
+		moves += cur - sift;
+	}
+
+	return 1;
+}
+
+static void K(_intro_sort)(ELEM *v, int begin, int end, int depth,
+			   bool leftmost)
+{
+	int size, p, lsize, rsize;
+	bool partitioned;
+
+	while (!CANCELLED()) {
+		size = end - begin;
+
+		if (size < INTRO_INSERTION) {
+			if (leaves && size > 1)
+				K(network_sort)(v, begin, size);
+			else
+				K(_insertion_sort)(v, begin, end - 1);
+			return;
+		}
+
+		if (depth-- == 0) {
+			K(heap_range)(v, begin, end);
+			return;
+		}
+
+		K(choose_pivot)(v, begin, end);
+
+		if (!leftmost && !LESS(v[begin-1], v[begin])) {
+			begin = K(partition_left)(v, begin, end) + 1;
+			continue;
+		}
+
+		p = K(partition_right)(v, begin, end, &partitioned);
+		lsize = p - begin;
+		rsize = end - (p + 1);
+
+		if (lsize < size / 8 || rsize < size / 8) {
+			/* unbalanced: break the pattern which caused it */
+			if (lsize >= INTRO_INSERTION) {
+				SWAP(v, begin, begin + lsize/4);
+				SWAP(v, p-1, p - lsize/4);
+			}
+
+			if (rsize >= INTRO_INSERTION) {
+				SWAP(v, p+1, p+1 + rsize/4);
+				SWAP(v, end-1, end - rsize/4);
+			}
+		}
+		else if (partitioned &&
+			 K(partial_insertion)(v, begin, p) &&
+			 K(partial_insertion)(v, p+1, end)) {
+			return;
+		}
+
+		/* recurse on the smaller side, loop on the other one */
+		if (lsize < rsize) {
+			K(_intro_sort)(v, begin, p, depth, leftmost);
+			begin = p + 1;
+			leftmost = 0;
+		}
+		else {
+			K(_intro_sort)(v, p+1, end, depth, 0);
+			end = p;
+		}
+	}
+}
+
+/*
+ * Parallel quick sort task: sort v[a..b], handing the smaller part of every
+ * partition over to the other workers while the range is big enough. The
+ * pivots and partitions are those of intro sort, so that runs of equal
+ * keys are split off, and so is the sort of the ranges left to a worker.
+ * A range not at the front of v follows the pivot of the partition which
+ * made it, not greater than any of its keys.
+ */
+static void K(pquick_task)(const Task *t)
+{
+	ELEM *v = t->ctx;
+	int l = t->a, r = t->b, p, depth;
+	bool partitioned;
+
+	RANGE(v, l, r);
+
+	while (r - l >= SPAWN_CUTOFF && !CANCELLED()) {
+		K(choose_pivot)(v, l, r+1);
+
+		if (l > 0 && !LESS(v[l-1], v[l])) {
+			l = K(partition_left)(v, l, r+1) + 1;
+			RANGE(v, l, r);
+			continue;
+		}
+
+		p = K(partition_right)(v, l, r+1, &partitioned);
+		if (p - l < r - p) {
+			if (l < p-1)
+				SPAWN(K(pquick_task), v, l, p-1);
+			l = p + 1;
+		}
+		else {
+			if (p+1 < r)
+				SPAWN(K(pquick_task), v, p+1, r);
+			r = p - 1;
+		}
+
+		RANGE(v, l, r);
+	}
+
+	for (depth=0; (1 << depth) < r - l + 1; ++depth)
+		;
+
+	if (l < r)
+		K(_intro_sort)(v, l, r+1, 2 * depth, l == 0);
+	RANGE(v, 1, 0);
+}
+
+/*
+ * Introselect: quickselect with the pivots and partitions of intro sort,
+ * moving the element of rank `k' to v[k], the smaller ones before it and
+ * the greater ones after. Once the depth budget is over the pivots are
+ * medians of medians, which keeps the selection linear.
+ */
+static void K(_select)(ELEM *v, int begin, int end, int k, int depth,
+		       bool leftmost);
+
+/*
+ * Median of medians of v[begin..end), at least INTRO_INSERTION elements:
+ * the medians of the groups of 5 are moved to the front and the median of
+ * them is selected. Return where it is. At least two other elements are
+ * not less than it, which bounds the unguarded scans of partition_right().
+ */
+static int K(median_of_medians)(ELEM *v, int begin, int end)
+{
+	int i, m;
+
+	for (m=0, i=begin; i+5<=end; i+=5, ++m) {
+		K(_insertion_sort)(v, i, i+4);
+		SWAP(v, begin+m, i+2);
+	}
+
+	K(_select)(v, begin, begin+m, begin+m/2, 0, 1);
+
+	return begin + m/2;
+}
+
+static void K(_select)(ELEM *v, int begin, int end, int k, int depth,
+		       bool leftmost)
+{
+	int size, p;
+	bool partitioned;
+
+	while (!CANCELLED()) {
+		size = end - begin;
+
+		if (size < INTRO_INSERTION) {
+			K(_insertion_sort)(v, begin, end - 1);
+			return;
+		}
+
+		if (depth > 0) {
+			--depth;
+			K(choose_pivot)(v, begin, end);
+		}
+		else {
+			SWAP(v, begin, K(median_of_medians)(v, begin, end));
+		}
+
+		/* the keys equal to the one before the range are split off,
+		 * as by intro sort: if v[k] is one of them it is done */
+		if (!leftmost && !LESS(v[begin-1], v[begin])) {
+			p = K(partition_left)(v, begin, end);
+			if (k <= p)
+				return;
+			begin = p + 1;
+			continue;
+		}
+
+		p = K(partition_right)(v, begin, end, &partitioned);
+		if (k == p)
+			return;
+
+		if (k < p) {
+			end = p;
+		}
+		else {
+			begin = p + 1;
+			leftmost = 0;
+		}
+	}
+}
+
+/*
+ * d-ary max-heap engine: the children of v[i] are v[d*i+1 .. d*i+d].
+ * Sift-down follows Floyd's bottom-up method: the hole left at the top
+ * is pushed down to a leaf along the greatest children, with no
+ * comparison against the key being placed, and the key is then sifted
+ * up from there. The grandchildren are prefetched while the children
+ * are compared.
+ */
+INLINE static void K(dheap_sift_down)(ELEM *v, int n, int d, int hole, ELEM x)
+{
+	int top, c, k, best, end, p;
+
+	top = hole;
+
+	for (c=d*hole+1; c<n; c=d*hole+1) {
+		if (d*c+1 < n)
+			__builtin_prefetch(&v[d*c+1]);
+
+		best = c;
+		end = c+d < n ? c+d : n;
+		for (k=c+1; k<end; ++k) {
+			STEP(v, best, k);
+			if (LESS(v[best], v[k]))
+				best = k;
+		}
+
+		MOVE(v, hole, v[best]);
+		hole = best;
+	}
+
+	for (; hole>top; hole=p) {
+		p = (hole-1) / d;
+		if (!LESS(v[p], x))
+			break;
+
+		MOVE(v, hole, v[p]);
+	}
+
+	MOVE(v, hole, x);
+}
+
+INLINE static void K(_dheap_sort)(ELEM *v, int n, int d)
+{
+	int i;
+	ELEM x;
+
+	/* (n-2)/d rounds towards 0, it would sift an empty heap: */
+	if (n < 2)
+		return;
+
+	for (i=(n-2)/d; i>=0 && !CANCELLED(); --i)
+		K(dheap_sift_down)(v, n, d, i, v[i]);
+
+	for (i=n-1; i>0 && !CANCELLED(); --i) {
+		x = v[i];
+		MOVE(v, i, v[0]);
+		K(dheap_sift_down)(v, i, d, 0, x);
+	}
+}
+
+/*
+ * Priority queue operations on a heap of `n' elements.
+ */
+UNUSED static void K(dheap_push)(ELEM *v, int n, int d, ELEM x)
+{
+	int hole, p;
+
+	for (hole=n; hole>0; hole=p) {
+		p = (hole-1) / d;
+		if (!LESS(v[p], x))
+			break;
+
+		MOVE(v, hole, v[p]);
+	}
+
+	MOVE(v, hole, x);
+}
+
+UNUSED static ELEM K(dheap_pop)(ELEM *v, int n, int d)
+{
+	ELEM top = v[0];
+
+	if (n > 1)
+		K(dheap_sift_down)(v, n-1, d, 0, v[n-1]);
+
+	return top;
+}
+
+/*
+ * Streaming top-k: `heap' is a max-heap of HEAP_ARITY children per node
+ * holding the `*size' smallest of the elements seen so far, up to `k'. An
+ * element gets in only if it is smaller than the greatest of them, which
+ * it replaces.
+ */
+UNUSED static void K(topk_push)(ELEM *heap, int *size, int k, const ELEM *v,
+				int n)
+{
+	int i;
+
+	for (i=0; i<n; ++i) {
+		if (*size < k)
+			K(dheap_push)(heap, (*size)++, HEAP_ARITY, v[i]);
+		else if (LESS(v[i], heap[0]))
+			K(dheap_sift_down)(heap, k, HEAP_ARITY, 0, v[i]);
+	}
+}
+
+/*
+ * Store the `size' elements of a top-k heap in `out', in order.
+ */
+UNUSED static void K(topk_get)(const ELEM *heap, int size, ELEM *out)
+{
+	int i;
+
+	for (i=0; i<size; ++i)
+		SCRATCH(out, i, heap[i]);
+
+	K(_dheap_sort)(out, size, HEAP_ARITY);
+}
+
+/*
+ * Merge the sorted batch b[0..m) into the sorted v[0..n), which has room
+ * for n+m elements, from the back: the elements of `v' smaller than the
+ * whole batch are not moved, and equal elements of the batch go after
+ * those of `v'. Return how many elements of `v' were moved.
+ */
+UNUSED static int K(merge_batch)(ELEM *v, int n, const ELEM *b, int m)
+{
+	int i = n - 1, j = m - 1, k = n + m - 1;
+
+	while (j >= 0) {
+		if (i >= 0 && LESS(b[j], v[i])) {
+			MOVE(v, k--, v[i]);
+			--i;
+		}
+		else {
+			MOVE(v, k--, b[j]);
+			--j;
+		}
+	}
+
+	return n - 1 - i;
+}
+
+/*
+ * Timsort: natural runs (descending ones reversed) extended to `minrun'
+ * elements by binary insertion, kept on a bounded stack and merged
+ * galloping whenever one run keeps winning.
+ */
+static int K(tim_count_run)(ELEM *v, int lo, int hi)
+{
+	int r = lo + 1, i, j;
+
+	if (r == hi)
+		return 1;
+
+	if (LESS(v[r], v[lo])) {
+		while (++r < hi && LESS(v[r], v[r-1]))
+			;
+		for (i=lo, j=r-1; i<j; ++i, --j)
+			SWAP(v, i, j);
+	}
+	else {
+		while (++r < hi && !LESS(v[r], v[r-1]))
+			;
+	}
+
+	return r - lo;
+}
+
+/*
+ * Sort v[lo..hi), v[lo..start) being already sorted.
+ */
+static void K(tim_binary_insertion)(ELEM *v, int lo, int hi, int start)
+{
+	int l, r, m, k;
+	ELEM x;
+
+	for (; start<hi; ++start) {
+		x = v[start];
+		l = lo;
+		r = start;
+
+		while (l < r) {
+			m = (l + r) / 2;
+			STEP(v, m, start);
+			if (LESS(x, v[m]))
+				r = m;
+			else
+				l = m + 1;
+		}
+
+		for (k=start; k>l; --k)
+			MOVE(v, k, v[k-1]);
+		MOVE(v, l, x);
+	}
+}
+
+/*
+ * Position of `key' in the sorted a[base..base+len), before the keys
+ * equal to it (gallop_left) or after them (gallop_right): the search
+ * starts at `hint' by exponential steps.
+ */
+static int K(gallop_left)(ELEM key, const ELEM *a, int base, int len, int hint)
+{
+	int last = 0, ofs = 1, max, tmp, m;
+
+	if (LESS(a[base+hint], key)) {
+		max = len - hint;
+		while (ofs < max && LESS(a[base+hint+ofs], key)) {
+			last = ofs;
+			ofs = ofs * 2 + 1;
+		}
+		if (ofs > max)
+			ofs = max;
+
+		last += hint;
+		ofs += hint;
+	}
+	else {
+		max = hint + 1;
+		while (ofs < max && !LESS(a[base+hint-ofs], key)) {
+			last = ofs;
+			ofs = ofs * 2 + 1;
+		}
+		if (ofs > max)
+			ofs = max;
+
+		tmp = last;
+		last = hint - ofs;
+		ofs = hint - tmp;
+	}
+
+	for (++last; last<ofs; ) {
+		m = last + (ofs - last) / 2;
+		if (LESS(a[base+m], key))
+			last = m + 1;
+		else
+			ofs = m;
+	}
+
+	return ofs;
+}
+
+static int K(gallop_right)(ELEM key, const ELEM *a, int base, int len, int hint)
+{
+	int last = 0, ofs = 1, max, tmp, m;
+
+	if (LESS(key, a[base+hint])) {
+		max = hint + 1;
+		while (ofs < max && LESS(key, a[base+hint-ofs])) {
+			last = ofs;
+			ofs = ofs * 2 + 1;
+		}
+		if (ofs > max)
+			ofs = max;
+
+		tmp = last;
+		last = hint - ofs;
+		ofs = hint - tmp;
+	}
+	else {
+		max = len - hint;
+		while (ofs < max && !LESS(key, a[base+hint+ofs])) {
+			last = ofs;
+			ofs = ofs * 2 + 1;
+		}
+		if (ofs > max)
+			ofs = max;
+
+		last += hint;
+		ofs += hint;
+	}
+
+	for (++last; last<ofs; ) {
+		m = last + (ofs - last) / 2;
+		if (LESS(key, a[base+m]))
+			ofs = m;
+		else
+			last = m + 1;
+	}
+
+	return ofs;
+}
+
+/*
+ * Copy `len' keys of `src' from `s' to v[d..]: forwards, or backwards when
+ * the ranges overlap with d > s.
+ */
+static void K(tim_copy)(ELEM *v, int d, const ELEM *src, int s, int len)
+{
+	int i;
+
+	if (src == v && d > s)
+		for (i=len-1; i>=0; --i)
+			MOVE(v, d+i, src[s+i]);
+	else
+		for (i=0; i<len; ++i)
+			MOVE(v, d+i, src[s+i]);
+}
+
+/*
+ * Merge the adjacent runs v[b1..b1+l1) and v[b2..b2+l2), l1 <= l2: the
+ * first run is moved to the scratch buffer and merged from the left.
+ */
+static void K(tim_merge_lo)(TimState *ts, ELEM *v, int b1, int l1, int b2,
+			    int l2)
+{
+	ELEM *tmp = ts->tmp;
+	int c1, c2, dest, n1, n2, mg, i;
+
+	for (i=0; i<l1; ++i)
+		SCRATCH(tmp, i, v[b1+i]);
+
+	c1 = 0;
+	c2 = b2;
+	dest = b1;
+
+	MOVE(v, dest, v[c2]);
+	++dest;
+	++c2;
+
+	if (--l2 == 0) {
+		K(tim_copy)(v, dest, tmp, c1, l1);
+		return;
+	}
+
+	if (l1 == 1) {
+		K(tim_copy)(v, dest, v, c2, l2);
+		MOVE(v, dest+l2, tmp[c1]);
+		return;
+	}
+
+	mg = ts->min_gallop;
+
+	for (;;) {
+		n1 = n2 = 0;
+
+		do {
+			if (LESS(v[c2], tmp[c1])) {
+				MOVE(v, dest, v[c2]);
+				++dest, ++c2, ++n2, n1 = 0;
+				if (--l2 == 0)
+					goto out;
+			}
+			else {
+				MOVE(v, dest, tmp[c1]);
+				++dest, ++c1, ++n1, n2 = 0;
+				if (--l1 == 1)
+					goto out;
+			}
+		} while ((n1 | n2) < mg);
+
+		do {
+			n1 = K(gallop_right)(v[c2], tmp, c1, l1, 0);
+			if (n1) {
+				K(tim_copy)(v, dest, tmp, c1, n1);
+				dest += n1, c1 += n1, l1 -= n1;
+				if (l1 <= 1)
+					goto out;
+			}
+
+			MOVE(v, dest, v[c2]);
+			++dest, ++c2;
+			if (--l2 == 0)
+				goto out;
+
+			n2 = K(gallop_left)(tmp[c1], v, c2, l2, 0);
+			if (n2) {
+				K(tim_copy)(v, dest, v, c2, n2);
+				dest += n2, c2 += n2, l2 -= n2;
+				if (l2 == 0)
+					goto out;
+			}
+
+			MOVE(v, dest, tmp[c1]);
+			++dest, ++c1;
+			if (--l1 == 1)
+				goto out;
+
+			--mg;
+		} while (n1 >= TIM_GALLOP || n2 >= TIM_GALLOP);
+
+		if (mg < 0)
+			mg = 0;
+		mg += 2;
+	}
+
+out:
+	ts->min_gallop = mg < 1 ? 1 : mg;
+
+	if (l1 == 1) {
+		K(tim_copy)(v, dest, v, c2, l2);
+		MOVE(v, dest+l2, tmp[c1]);
+	}
+	else {
+		K(tim_copy)(v, dest, tmp, c1, l1);
+	}
+}
+
+/*
+ * Same, l1 > l2: the second run is moved to the scratch buffer and the
+ * merge proceeds from the right.
+ */
+static void K(tim_merge_hi)(TimState *ts, ELEM *v, int b1, int l1, int b2,
+			    int l2)
+{
+	ELEM *tmp = ts->tmp;
+	int c1, c2, dest, n1, n2, mg, i;
+
+	for (i=0; i<l2; ++i)
+		SCRATCH(tmp, i, v[b2+i]);
+
+	c1 = b1 + l1 - 1;
+	c2 = l2 - 1;
+	dest = b2 + l2 - 1;
+
+	MOVE(v, dest, v[c1]);
+	--dest;
+	--c1;
+
+	if (--l1 == 0) {
+		K(tim_copy)(v, dest - (l2-1), tmp, 0, l2);
+		return;
+	}
+
+	if (l2 == 1) {
+		dest -= l1;
+		c1 -= l1;
+		K(tim_copy)(v, dest+1, v, c1+1, l1);
+		MOVE(v, dest, tmp[c2]);
+		return;
+	}
+
+	mg = ts->min_gallop;
+
+	for (;;) {
+		n1 = n2 = 0;
+
+		do {
+			if (LESS(tmp[c2], v[c1])) {
+				MOVE(v, dest, v[c1]);
+				--dest, --c1, ++n1, n2 = 0;
+				if (--l1 == 0)
+					goto out;
+			}
+			else {
+				MOVE(v, dest, tmp[c2]);
+				--dest, --c2, ++n2, n1 = 0;
+				if (--l2 == 1)
+					goto out;
+			}
+		} while ((n1 | n2) < mg);
+
+		do {
+			n1 = l1 - K(gallop_right)(tmp[c2], v, b1, l1, l1-1);
+			if (n1) {
+				dest -= n1, c1 -= n1, l1 -= n1;
+				K(tim_copy)(v, dest+1, v, c1+1, n1);
+				if (l1 == 0)
+					goto out;
+			}
+
+			MOVE(v, dest, tmp[c2]);
+			--dest, --c2;
+			if (--l2 == 1)
+				goto out;
+
+			n2 = l2 - K(gallop_left)(v[c1], tmp, 0, l2, l2-1);
+			if (n2) {
+				dest -= n2, c2 -= n2, l2 -= n2;
+				K(tim_copy)(v, dest+1, tmp, c2+1, n2);
+				if (l2 <= 1)
+					goto out;
+			}
+
+			MOVE(v, dest, v[c1]);
+			--dest, --c1;
+			if (--l1 == 0)
+				goto out;
+
+			--mg;
+		} while (n1 >= TIM_GALLOP || n2 >= TIM_GALLOP);
+
+		if (mg < 0)
+			mg = 0;
+		mg += 2;
+	}
+
+out:
+	ts->min_gallop = mg < 1 ? 1 : mg;
+
+	if (l2 == 1) {
+		dest -= l1;
+		c1 -= l1;
+		K(tim_copy)(v, dest+1, v, c1+1, l1);
+		MOVE(v, dest, tmp[c2]);
+	}
+	else {
+		K(tim_copy)(v, dest - (l2-1), tmp, 0, l2);
+	}
+}
+
+/*
+ * Merge the runs `i' and `i'+1 of the stack.
+ */
+static void K(tim_merge_at)(TimState *ts, ELEM *v, int i)
+{
+	int b1, l1, b2, l2, k;
+
+	b1 = ts->base[i];
+	l1 = ts->len[i];
+	b2 = ts->base[i+1];
+	l2 = ts->len[i+1];
+
+	ts->len[i] = l1 + l2;
+	if (i == ts->size - 3) {
+		ts->base[i+1] = ts->base[i+2];
+		ts->len[i+1] = ts->len[i+2];
+	}
+	--ts->size;
+
+	MARK_RUN(v, b1, b2 + l2 - 1);
+
+	/* keys already in place at both ends are left alone */
+	k = K(gallop_right)(v[b2], v, b1, l1, 0);
+	b1 += k;
+	l1 -= k;
+	if (!l1)
+		return;
+
+	l2 = K(gallop_left)(v[b1+l1-1], v, b2, l2, l2-1);
+	if (!l2)
+		return;
+
+	if (l1 <= l2)
+		K(tim_merge_lo)(ts, v, b1, l1, b2, l2);
+	else
+		K(tim_merge_hi)(ts, v, b1, l1, b2, l2);
+}
+
+/*
+ * Merge the top of the stack until the run lengths decrease at least as
+ * fast as the Fibonacci numbers, which bounds the stack to TIM_STACK runs.
+ */
+static void K(tim_merge_collapse)(TimState *ts, ELEM *v)
+{
+	int n;
+	int *len = ts->len;
+
+	while (ts->size > 1) {
+		n = ts->size - 2;
+
+		if ((n > 0 && len[n-1] <= len[n] + len[n+1]) ||
+		    (n > 1 && len[n-2] <= len[n-1] + len[n])) {
+			if (len[n-1] < len[n+1])
+				--n;
+		}
+		else if (len[n] > len[n+1]) {
+			break;
+		}
+
+		K(tim_merge_at)(ts, v, n);
+	}
+}
+
+static void K(tim_sort)(ELEM *v, int n)
+{
+	TimState ts;
+	int lo, run, force, minrun, r;
+
+	if (n < 2)
+		return;
+
+	if (n < TIM_MINMERGE) {
+		run = K(tim_count_run)(v, 0, n);
+		K(tim_binary_insertion)(v, 0, n, run);
+		return;
+	}
+
+	ts.tmp = malloc((n/2 + 1) * sizeof(ELEM));
+	if (!ts.tmp) {
+		log_err("tim sort: could not allocate %d elements", n/2 + 1);
+		return;
+	}
+
+	ts.min_gallop = TIM_GALLOP;
+	ts.size = 0;
+
+	for (r=0, minrun=n; minrun>=TIM_MINMERGE; minrun/=2)
+		r |= minrun & 1;
+	minrun += r;
+
+	for (lo=0; lo<n && !CANCELLED(); lo+=run) {
+		run = K(tim_count_run)(v, lo, n);
+		if (run < minrun) {
+			force = n - lo < minrun ? n - lo : minrun;
+			/* a short natural run is not worth keeping */
+			if (leaves && KEYS_ONLY && run < force / 2)
+				K(network_sort)(v, lo, force);
+			else
+				K(tim_binary_insertion)(v, lo, lo + force,
+							lo + run);
+			run = force;
+		}
+
+		ts.base[ts.size] = lo;
+		ts.len[ts.size] = run;
+		++ts.size;
+		MARK_RUN(v, lo, lo + run - 1);
+
+		K(tim_merge_collapse)(&ts, v);
+	}
+
+	while (ts.size > 1 && !CANCELLED()) {
+		r = ts.size - 2;
+		if (r > 0 && ts.len[r-1] < ts.len[r+1])
+			--r;
+		K(tim_merge_at)(&ts, v, r);
+	}
+
+	free(ts.tmp);
+}
+
+/*
+ * Merge src[i..m) with src[j..r) into dst[k..end): the merge stops after
+ * end-k elements, so that a merge can be split among several tasks.
+ * Only the writes landing in `v' are traced.
+ */
+static void K(merge)(const ELEM *src, ELEM *dst, ELEM *v,
+		     int i, int m, int j, int r, int k, int end)
+{
+#ifdef MERGE_VECTOR
+	MERGE_VECTOR(src, dst, i, m, j, r, k, end);
+#else
+	ELEM x;
+
+	for (; k<end; ++k) {
+		if (j >= r || (i < m && !LESS(src[j], src[i])))
+			x = src[i++];
+		else
+			x = src[j++];
+
+		if (dst == v)
+			MOVE(dst, k, x);
+		else
+			SCRATCH(dst, k, x);
+	}
+#endif
+}
+
+/*
+ * Number of elements of src[l..m) among the first `k' elements of their
+ * stable merge with src[m..r).
+ */
+static int K(corank)(const ELEM *src, int l, int m, int r, int k)
+{
+	int lo, hi, i;
+
+	lo = k > r - m ? k - (r - m) : 0;
+	hi = k < m - l ? k : m - l;
+
+	while (lo < hi) {
+		i = (lo + hi) / 2;
+		if (!LESS(src[m + k - i - 1], src[l + i]))
+			lo = i + 1;
+		else
+			hi = i;
+	}
+
+	return lo;
+}
+
+/*
+ * Bottom-up merge sort of v[l..r), bouncing between `v' and `tmp' at
+ * every pass: runs of MERGE_RUN elements are sorted first, by a network
+ * or by insertion.
+ */
+static void K(_merge_sort)(ELEM *v, ELEM *tmp, int l, int r)
+{
+	ELEM *src, *dst, *t;
+	int a, m, e, w;
+
+	for (a=l; a<r && !CANCELLED(); a+=MERGE_RUN) {
+		e = a+MERGE_RUN < r ? a+MERGE_RUN : r;
+		if (leaves && KEYS_ONLY)
+			K(network_sort)(v, a, e - a);
+		else
+			K(_insertion_sort)(v, a, e - 1);
+	}
+
+	src = v;
+	dst = tmp;
+
+	for (w=MERGE_RUN; w<r-l && !CANCELLED(); w*=2) {
+		for (a=l; a<r; a+=2*w) {
+			m = a+w < r ? a+w : r;
+			e = a+2*w < r ? a+2*w : r;
+			K(merge)(src, dst, v, a, m, m, e, a, e);
+		}
+
+		t = src;
+		src = dst;
+		dst = t;
+	}
+
+	if (src != v)
+		for (a=l; a<r; ++a)
+			MOVE(v, a, tmp[a]);
+}
+
+/*
+ * Parallel merge sort tasks: blocks of `width' elements are sorted
+ * independently, then every pass splits its merges in chunks of
+ * SPAWN_CUTOFF output elements (see corank()).
+ */
+static void K(pmerge_block)(const Task *t)
+{
+	MergePass *p = t->ctx;
+
+	RANGE(p->v, t->a, t->b - 1);
+	K(_merge_sort)(p->v, p->dst, t->a, t->b);
+	RANGE(p->v, 1, 0);
+}
+
+static void K(pmerge_blocks)(const Task *t)
+{
+	MergePass *p = t->ctx;
+	int l;
+
+	for (l=0; l<p->n && !CANCELLED(); l+=p->width)
+		SPAWN(K(pmerge_block), p, l,
+		      l+p->width < p->n ? l+p->width : p->n);
+}
+
+static void K(pmerge_chunk)(const Task *t)
+{
+	MergePass *p = t->ctx;
+	int a, m, e, i, k;
+
+	a = t->a - t->a % (2 * p->width);
+	m = a+p->width < p->n ? a+p->width : p->n;
+	e = a+2*p->width < p->n ? a+2*p->width : p->n;
+
+	k = t->a - a;
+	i = K(corank)(p->src, a, m, e, k);
+
+	RANGE(p->v, t->a, t->b - 1);
+	K(merge)(p->src, p->dst, p->v, a+i, m, m+k-i, e, t->a, t->b);
+	RANGE(p->v, 1, 0);
+}
+
+static void K(pmerge_pass)(const Task *t)
+{
+	MergePass *p = t->ctx;
+	int a, e, o;
+
+	for (a=0; a<p->n; a+=2*p->width) {
+		e = a+2*p->width < p->n ? a+2*p->width : p->n;
+
+		for (o=a; o<e; o+=SPAWN_CUTOFF)
+			SPAWN(K(pmerge_chunk), p, o,
+			      o+SPAWN_CUTOFF < e ? o+SPAWN_CUTOFF : e);
+	}
+}
+
+static void K(insertion_sort)(ELEM *v, int n)
+{
+	K(_insertion_sort)(v, 0, n-1);
+}
+
+static void K(quick_sort)(ELEM *v, int n)
+{
+	K(_quick_sort)(v, 0, n-1);
+}
+
+static void K(block_quick_sort)(ELEM *v, int n)
+{
+	K(_block_quick_sort)(v, 0, n-1);
+}
+
+static void K(vector_quick_sort)(ELEM *v, int n)
+{
+	K(_vector_quick_sort)(v, 0, n-1, 0);
+}
+
+static void K(parallel_quick_sort)(ELEM *v, int n)
+{
+	if (n > 1)
+		RUN(K(pquick_task), v, 0, n-1);
+}
+
+static void K(merge_sort)(ELEM *v, int n)
+{
+	ELEM *tmp;
+
+	tmp = malloc(n * sizeof(ELEM));
+	if (!tmp) {
+		log_err("merge sort: could not allocate %d elements", n);
+		return;
+	}
+
+	K(_merge_sort)(v, tmp, 0, n);
+	free(tmp);
+}
+
+static void K(parallel_merge_sort)(ELEM *v, int n)
+{
+	MergePass pass;
+	ELEM *t;
+	int a;
+
+	if (n < 2)
+		return;
+
+	pass.v = v;
+	pass.n = n;
+	pass.src = v;
+	pass.dst = malloc(n * sizeof(ELEM));
+	if (!pass.dst) {
+		log_err("merge sort: could not allocate %d elements", n);
+		return;
+	}
+
+	pass.width = SPAWN_CUTOFF;
+	RUN(K(pmerge_blocks), &pass, 0, n);
+
+	for (; pass.width<n && !CANCELLED(); pass.width*=2) {
+		RUN(K(pmerge_pass), &pass, 0, n);
+
+		t = pass.src;
+		pass.src = pass.dst;
+		pass.dst = t;
+	}
+
+	if (pass.src != v) {
+		t = pass.src;
+		for (a=0; a<n; ++a)
+			MOVE(v, a, t[a]);
+		pass.dst = pass.src;
+	}
+
+	free(pass.dst);
+}
+
+static void K(radix_sort) (ELEM *v, int n);
+
+/*
+ * Counting sort: two reads find the range of the keys and build their
+ * histogram, then the array is rewritten key by key. Key ranges wider
+ * than COUNTING_MAX, or than COUNTING_SPREAD keys per element, are left to
+ * the radix sort, and records, which cannot be rebuilt from their keys,
+ * are scattered through a scratch buffer instead.
+ */
+static void K(counting_sort)(ELEM *v, int n)
+{
+	u32 *count;
+	KEY_T min, max, key;
+	u32 range, c;
+	int i, k;
+#ifndef FROM_KEY
+	ELEM *tmp;
+	u32 sum;
+#endif
+
+	if (n < 2)
+		return;
+
+	min = max = READ_KEY(v[0]);
+	for (i=1; i<n; ++i) {
+		key = READ_KEY(v[i]);
+		if (key < min)
+			min = key;
+		if (key > max)
+			max = key;
+	}
+
+	if (max - min >= COUNTING_MAX ||
+	    (u64)(max - min) > (u64)COUNTING_SPREAD * n) {
+		K(radix_sort)(v, n);
+		return;
+	}
+
+	range = max - min + 1;
+	count = calloc(range, sizeof(u32));
+	if (!count) {
+		log_err("counting sort: could not allocate %u counters", range);
+		return;
+	}
+
+	for (i=0; i<n && !CANCELLED(); ++i) {
+		STEP(v, i, i);
+		++count[READ_KEY(v[i]) - min];
+	}
+
+#ifdef FROM_KEY
+	for (k=0, i=0; k<(int)range; ++k)
+		for (c=count[k]; c; --c, ++i)
+			MOVE(v, i, FROM_KEY(min + k));
+#else
+	tmp = malloc(n * sizeof(ELEM));
+	if (!tmp) {
+		log_err("counting sort: could not allocate %d elements", n);
+		free(count);
+		return;
+	}
+
+	for (sum=0, k=0; k<(int)range; ++k) {
+		c = count[k];
+		count[k] = sum;
+		sum += c;
+	}
+
+	for (i=0; i<n; ++i)
+		SCRATCH(tmp, count[READ_KEY(v[i]) - min]++, v[i]);
+
+	for (i=0; i<n; ++i)
+		MOVE(v, i, tmp[i]);
+
+	free(tmp);
+#endif
+
+	free(count);
+}
+
+/*
+ * LSD radix sort, one byte of the key per pass. The histograms of all the
+ * digits are built by a single read and a pass is skipped when its digit
+ * is the same for every element. The scatter writes are traced whichever
+ * buffer they land in, so that the replay shows every pass.
+ */
+static void K(radix_sort)(ELEM *v, int n)
+{
+	u32 count[sizeof(KEY_T)][RADIX_BUCKETS];
+	u32 pos, sum, c;
+	ELEM *src, *dst, *tmp, x;
+	KEY_T key;
+	int i, d, b;
+
+	if (n < 2)
+		return;
+
+	tmp = malloc(n * sizeof(ELEM));
+	if (!tmp) {
+		log_err("radix sort: could not allocate %d elements", n);
+		return;
+	}
+
+	memset(count, 0, sizeof(count));
+
+	for (i=0; i<n; ++i) {
+		STEP(v, i, i);
+		key = READ_KEY(v[i]);
+		for (d=0; d<(int)sizeof(KEY_T); ++d)
+			++count[d][(key >> (d * RADIX_BITS)) &
+				   (RADIX_BUCKETS-1)];
+	}
+
+	src = v;
+	dst = tmp;
+
+	for (d=0; d<(int)sizeof(KEY_T) && !CANCELLED(); ++d) {
+		if (count[d][(READ_KEY(v[0]) >> (d * RADIX_BITS)) &
+			     (RADIX_BUCKETS-1)] == (u32)n)
+			continue;
+
+		for (sum=0, b=0; b<RADIX_BUCKETS; ++b) {
+			c = count[d][b];
+			count[d][b] = sum;
+			sum += c;
+		}
+
+		for (i=0; i<n; ++i) {
+			x = src[i];
+			pos = count[d][(READ_KEY(x) >> (d * RADIX_BITS)) &
+				       (RADIX_BUCKETS-1)]++;
+			MOVE(dst, pos, x);
+		}
+
+		src = dst;
+		dst = src == v ? tmp : v;
+	}
+
+	if (src != v)
+		for (i=0; i<n; ++i)
+			MOVE(v, i, tmp[i]);
+
+	free(tmp);
+}
+
+static void K(intro_sort)(ELEM *v, int n)
+{
+	int depth;
+
+	for (depth=0; (1 << depth) < n; ++depth)
+		;
+
+	K(_intro_sort)(v, 0, n, 2 * depth, 1);
+}
+
+/*
+ * Parallel sample sort tasks: every block is classified through the
+ * splitter tree, without branching on the comparisons, into the histogram
+ * of its row of `count', then scattered into the buckets at the offsets of
+ * that row. In between, the pages of every bucket are first touched by one
+ * of the workers, which owns it from then on (on NUMA systems, they are
+ * placed on its node). Every worker finally sorts the buckets it owns
+ * where they are, moves them back, and helps with the others once done.
+ */
+static void K(sample_blocks)(const Task *t)
+{
+	SamplePass *p = t->ctx;
+	int i;
+
+	for (i=0; i<p->nblocks; ++i)
+		SPAWN(p->step, p, i, 0);
+}
+
+static void K(sample_workers)(const Task *t)
+{
+	SamplePass *p = t->ctx;
+	u32 i;
+
+	for (i=0; i<nthreads; ++i)
+		SPAWN(p->step, p, i, 0);
+}
+
+static void K(sample_classify)(const Task *t)
+{
+	SamplePass *p = t->ctx;
+	const ELEM *tree = p->tree, *splitters = p->splitters;
+	ELEM *v = p->v;
+	u32 *count = p->count + t->a * p->nbuckets;
+	int i, j, l, a, e, last;
+
+	a = t->a * p->block;
+	e = a + p->block < p->n ? a + p->block : p->n;
+	last = (1 << p->log) - 1;
+
+	RANGE(v, a, e - 1);
+
+	for (i=a; i<e && !CANCELLED(); ++i) {
+		STEP(v, i, i);
+
+		j = 1;
+		for (l=0; l<p->log; ++l)
+			j = 2*j + LESS(tree[j], v[i]);
+
+		/* v[i] is not greater than splitters[j], but may be equal: */
+		j -= 1 << p->log;
+		if (p->equal)
+			j = 2*j + ((j < last) & !LESS(v[i], splitters[j]));
+
+		p->oracle[i] = j;
+		++count[j];
+	}
+
+	RANGE(v, 1, 0);
+}
+
+#ifndef BUCKETS_IN_PLACE
+static void K(sample_place)(const Task *t)
+{
+	SamplePass *p = t->ctx;
+	volatile char *tmp = p->tmp;
+	size_t i, e;
+	u32 b;
+
+	while ((b = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED)) <
+	       (u32)p->nbuckets) {
+		e = (size_t)p->bucket[b+1] * sizeof(ELEM);
+		for (i=(size_t)p->bucket[b] * sizeof(ELEM); i<e;
+		     i+=SAMPLE_PAGE)
+			tmp[i] = 0;
+
+		p->owner[b] = sched_self();
+	}
+}
+#endif
+
+static void K(sample_scatter)(const Task *t)
+{
+	SamplePass *p = t->ctx;
+	const ELEM *v = p->v;
+	ELEM *tmp = p->tmp;
+	u32 *offset = p->count + t->a * p->nbuckets;
+	int i, a, e;
+
+	a = t->a * p->block;
+	e = a + p->block < p->n ? a + p->block : p->n;
+
+	for (i=a; i<e && !CANCELLED(); ++i)
+		SCRATCH(tmp, offset[p->oracle[i]]++, v[i]);
+}
+
+static void K(sample_move)(const Task *t)
+{
+	SamplePass *p = t->ctx;
+	const ELEM *tmp = p->tmp;
+	ELEM *v = p->v;
+	int i;
+
+	RANGE(v, t->a, t->b - 1);
+	for (i=t->a; i<(int)t->b; ++i)
+		MOVE(v, i, tmp[i]);
+	RANGE(v, 1, 0);
+}
+
+/*
+ * Sort bucket `b' and move it back; equality buckets are moved back alone,
+ * a block at a time by any worker.
+ */
+static void K(sample_bucket)(SamplePass *p, int b)
+{
+	ELEM *tmp = p->tmp, *v = p->v;
+	int i, a, e, depth;
+
+	a = p->bucket[b];
+	e = p->bucket[b+1];
+
+	if (p->equal && (b & 1)) {
+		for (i=a; i<e; i+=p->block)
+			SPAWN(K(sample_move), p, i, i+p->block < e ? i+p->block : e);
+		return;
+	}
+
+	for (depth=0; (1 << depth) < e - a; ++depth)
+		;
+
+	RANGE(v, a, e - 1);
+
+#ifdef BUCKETS_IN_PLACE
+	for (i=a; i<e; ++i)
+		MOVE(v, i, tmp[i]);
+
+	K(_intro_sort)(v, a, e, 2 * depth, 1);
+#else
+	K(_intro_sort)(tmp, a, e, 2 * depth, 1);
+
+	for (i=a; i<e; ++i)
+		MOVE(v, i, tmp[i]);
+#endif
+
+	RANGE(v, 1, 0);
+}
+
+static void K(sample_buckets)(const Task *t)
+{
+	SamplePass *p = t->ctx;
+	u32 self = sched_self();
+	int b, any;
+
+	/* a bucket of one key, or one whose sort was cancelled, still has
+	 * to be moved back: */
+	for (any=0; any<2; ++any)
+		for (b=0; b<p->nbuckets; ++b)
+			if ((any || p->owner[b] == self) &&
+			    p->bucket[b+1] > p->bucket[b] &&
+			    !__atomic_test_and_set(&p->claimed[b],
+						   __ATOMIC_RELAXED))
+				K(sample_bucket)(p, b);
+}
+
+/*
+ * qsort(3) order of the elements, for the sample: it is neither counted
+ * nor traced.
+ */
+static int K(compare)(const void *a, const void *b)
+{
+	const ELEM *x = a, *y = b;
+
+	return ELEM_LESS(*y, *x) - ELEM_LESS(*x, *y);
+}
+
+/*
+ * Pick the splitters of 2^`log' buckets from a sorted sample of
+ * SAMPLE_OVERSAMPLING keys per bucket, in order in `splitters' (one more
+ * slot repeats the last) and laid out as an implicit binary tree in
+ * `tree': node j, at depth d, is the splitter of in-order rank
+ * (2*(j - 2^d) + 1) * 2^(log-d-1) - 1.
+ * Repeated splitters, that is keys filling whole buckets, set `equal': the
+ * buckets are then halved if needed, so that with their equality buckets
+ * they still fit in a byte. Return the log 2 of the buckets, or -1 on
+ * error.
+ */
+static int K(sample_tree)(const ELEM *v, int n, int log, ELEM *tree,
+			  ELEM *splitters, bool *equal)
+{
+	ELEM *sample;
+	int s, i, j, d, r, stride, step;
+
+	s = SAMPLE_OVERSAMPLING << log;
+	sample = malloc(s * sizeof(ELEM));
+	if (!sample)
+		return -1;
+
+	/* one key from every stride, at a scrambled place: */
+	stride = n / s;
+	for (i=0; i<s; ++i)
+		sample[i] = v[i * stride + (u32)(i * 2654435761u) % stride];
+
+	qsort(sample, s, sizeof(ELEM), K(compare));
+
+	*equal = 0;
+	for (r=1; r < (1 << log) - 1; ++r)
+		if (!ELEM_LESS(sample[r * SAMPLE_OVERSAMPLING],
+			       sample[(r+1) * SAMPLE_OVERSAMPLING]))
+			*equal = 1;
+
+	if (*equal && (2 << log) > SAMPLE_BUCKETS)
+		--log;
+
+	step = s >> log;
+	for (r=0; r < (1 << log) - 1; ++r)
+		splitters[r] = sample[(r+1) * step];
+	splitters[r] = splitters[r-1];
+
+	for (d=0; d<log; ++d)
+		for (j=1<<d; j < 2<<d; ++j)
+			tree[j] = splitters[((2*(j - (1 << d)) + 1) <<
+					     (log - d - 1)) - 1];
+
+	free(sample);
+
+	return log;
+}
+
+static void K(parallel_sample_sort)(ELEM *v, int n)
+{
+	ELEM tree[SAMPLE_BUCKETS], splitters[SAMPLE_BUCKETS];
+	SamplePass pass;
+	u32 bucket[SAMPLE_BUCKETS + 1];
+	u8 owner[SAMPLE_BUCKETS];
+	bool claimed[SAMPLE_BUCKETS];
+	int log, b, i;
+	u32 sum, size;
+
+	log = 0;
+	while ((2 << log) <= SAMPLE_BUCKETS && (SAMPLE_MIN << (log + 1)) <= n)
+		++log;
+
+	if (!log) {
+		K(intro_sort)(v, n);
+		return;
+	}
+
+	pass.block = (n + SAMPLE_BLOCKS - 1) / SAMPLE_BLOCKS;
+	if (pass.block < SPAWN_CUTOFF)
+		pass.block = SPAWN_CUTOFF;
+	pass.nblocks = (n + pass.block - 1) / pass.block;
+
+	pass.v = v;
+	pass.n = n;
+	pass.tree = tree;
+	pass.splitters = splitters;
+	pass.bucket = bucket;
+	pass.owner = owner;
+	pass.claimed = claimed;
+	pass.tmp = NULL;
+	pass.oracle = NULL;
+	pass.count = NULL;
+
+	pass.log = K(sample_tree)(v, n, log, tree, splitters, &pass.equal);
+	if (pass.log < 0)
+		goto fail;
+	pass.nbuckets = (1 << pass.log) << pass.equal;
+
+	/* the buckets are not touched here, but placed by their owners: */
+	pass.tmp = malloc(n * sizeof(ELEM));
+	pass.oracle = malloc(n);
+	pass.count = calloc(pass.nblocks * pass.nbuckets, sizeof(u32));
+	if (!pass.tmp || !pass.oracle || !pass.count)
+		goto fail;
+
+	pass.step = K(sample_classify);
+	RUN(K(sample_blocks), &pass, 0, 0);
+
+	/* prefix sum, bucket by bucket: every block gets the offsets its
+	 * keys go to in every bucket */
+	sum = 0;
+	for (b=0; b<pass.nbuckets; ++b) {
+		bucket[b] = sum;
+		for (i=0; i<pass.nblocks; ++i) {
+			size = pass.count[i * pass.nbuckets + b];
+			pass.count[i * pass.nbuckets + b] = sum;
+			sum += size;
+		}
+	}
+	bucket[pass.nbuckets] = sum;
+
+	memset(owner, 0, sizeof(owner));
+	memset(claimed, 0, sizeof(claimed));
+
+#ifndef BUCKETS_IN_PLACE
+	pass.next = 0;
+	pass.step = K(sample_place);
+	RUN(K(sample_workers), &pass, 0, 0);
+#endif
+
+	pass.step = K(sample_scatter);
+	RUN(K(sample_blocks), &pass, 0, 0);
+
+	if (!CANCELLED()) {
+		pass.step = K(sample_buckets);
+		RUN(K(sample_workers), &pass, 0, 0);
+	}
+
+	goto out;
+
+fail:
+	log_err("sample sort: could not allocate %d elements", n);
+out:
+	free(pass.tmp);
+	free(pass.oracle);
+	free(pass.count);
+}
+
+static void K(dary_heap_sort)(ELEM *v, int n)
+{
+	/* one instance per arity, so that `d' is a constant: */
+	switch (heap_arity) {
+	case 2:
+		K(_dheap_sort)(v, n, 2);
+		break;
+
+	case 8:
+		K(_dheap_sort)(v, n, 8);
+		break;
+
+	default:
+		K(_dheap_sort)(v, n, 4);
+	}
+}
+
+static void K(heap_sort)(ELEM *v, int n)
+{
+	int i;
+
+	for (i=n/2-1; i>=0 && !CANCELLED(); --i)
+		K(heapify)(v, i, n);
+    
+	for (i=n-1; i>0 && !CANCELLED(); --i) {
+		SWAP(v, 0, i);
+		K(heapify)(v, 0, i);
+	}
+}
+
+static void K(auto_sort) (ELEM *v, int n);
+
+static const K(SortFunc) K(sort_funcs)[SORT_TYPE_COUNT] = {
+	[BUBBLE_SORT]		= K(bubble_sort),
+	[SELECTION_SORT]	= K(selection_sort),
+	[INSERTION_SORT]	= K(insertion_sort),
+	[QUICK_SORT]		= K(quick_sort),
+	[HEAP_SORT]		= K(heap_sort),
+	[BLOCK_QUICK_SORT]	= K(block_quick_sort),
+	[VECTOR_QUICK_SORT]	= K(vector_quick_sort),
+	[PARALLEL_QUICK_SORT]	= K(parallel_quick_sort),
+	[MERGE_SORT]		= K(merge_sort),
+	[PARALLEL_MERGE_SORT]	= K(parallel_merge_sort),
+	[PARALLEL_SAMPLE_SORT]	= K(parallel_sample_sort),
+	[COUNTING_SORT]		= K(counting_sort),
+	[RADIX_SORT]		= K(radix_sort),
+	[INTRO_SORT]		= K(intro_sort),
+	[DARY_HEAP_SORT]	= K(dary_heap_sort),
+	[TIM_SORT]		= K(tim_sort),
+	[AUTO_SORT]		= K(auto_sort),
+};
+
+/*
+ * Presortedness profile of `v', from the keys of AUTO_SAMPLE pairs of
+ * neighbours (a quarter of the pairs at most) spread over it, each at a
+ * hashed offset inside its stride so that periodic inputs are not sampled
+ * at the same phase every time. The pairs in descending order estimate
+ * the runs; merge sorting the first keys of the pairs counts their
+ * inversions, then gives their range and the distinct keys, estimated
+ * from the keys seen once and the others as in the GEE estimator
+ * (Charikar et al., 2000).
+ */
+static void K(profile)(const ELEM *v, int n, SortProfile *p)
+{
+	KEY_T buf[2][AUTO_SAMPLE], *key, *tmp, *t;
+	u64 descents, inversions;
+	u32 ones, distinct, at, step, rest, carry, stride;
+	int i, j, k, w, mid, end, m;
+
+	memset(p, 0, sizeof(*p));
+
+	m = (n - 1) / 4 < AUTO_SAMPLE ? (n - 1) / 4 : AUTO_SAMPLE;
+	if (m < 1) {
+		p->runs = p->distinct = n;
+		return;
+	}
+
+	key = buf[0];
+	tmp = buf[1];
+
+	/* strides of (n - 1) / m pairs, one more every `rest'/`m' of them: */
+	step = (n - 1) / m;
+	rest = (n - 1) % m;
+	descents = 0;
+	for (i=0, at=0, carry=0; i<m; ++i, at+=stride) {
+		carry += rest;
+		stride = step + (carry >= (u32)m);
+		if (carry >= (u32)m)
+			carry -= m;
+
+		j = at + ((u64)(i * 2654435761u) * stride >> 32);
+		key[i] = READ_KEY(v[j]);
+		if (READ_KEY(v[j+1]) < key[i])
+			++descents;
+	}
+
+	/* a key taken from the right run passes those left in the left one: */
+	inversions = 0;
+	for (w=1; w<m; w*=2) {
+		for (i=0; i<m; i+=2*w) {
+			mid = i + w < m ? i + w : m;
+			end = i + 2*w < m ? i + 2*w : m;
+			for (j=i, k=mid, at=i; at<(u32)end; ++at) {
+				if (k < end && (j >= mid || key[k] < key[j])) {
+					inversions += mid - j;
+					tmp[at] = key[k++];
+				}
+				else {
+					tmp[at] = key[j++];
+				}
+			}
+		}
+
+		t = key;
+		key = tmp;
+		tmp = t;
+	}
+
+	ones = distinct = 0;
+	for (i=0; i<m; i=j) {
+		for (j=i+1; j<m && key[j]==key[i]; ++j)
+			;
+		++distinct;
+		if (j - i == 1)
+			++ones;
+	}
+
+	p->sample = m;
+	p->runs = 1 + descents * (n - 1) / m;
+	p->inversions = m > 1 ? 2.0 * inversions / ((u64)m * (m - 1)) : 0;
+	p->distinct = isqrt(n / m) * ones + distinct - ones;
+	if (p->distinct > (u64)n)
+		p->distinct = n;
+	p->range = key[m-1] - key[0];
+}
+
+/*
+ * Automatic choice: profile the input, then sort it by the kernel chosen
+ * for the profile (see auto_choose()).
+ */
+static void K(auto_sort)(ELEM *v, int n)
+{
+	SortProfile p;
+	u64 t0;
+
+	t0 = clock_ns();
+	K(profile)(v, n, &p);
+	p.choice = auto_choose(&p, n);
+	p.ns = clock_ns() - t0;
+	auto_done(&p, n);
+
+	K(sort_funcs)[p.choice](v, n);
+}
+
+static void K(select)(ELEM *v, int n, int k)
+{
+	int depth;
+
+	for (depth=0; (1 << depth) < n; ++depth)
+		;
+
+	K(_select)(v, 0, n, k, 2 * depth, 1);
+}
+
+/*
+ * Partial sort: the `k' smallest elements are selected into v[0..k), then
+ * sorted by `algo'.
+ */
+static void K(partial_sort)(ELEM *v, int n, int k, SortType algo)
+{
+	if (k < n)
+		K(select)(v, n, k);
+
+	if (k > 1 && !CANCELLED())
+		K(sort_funcs)[algo](v, k);
+}
+
+UNUSED static bool K(is_sorted)(const ELEM *v, int n)
+{
+	int i;
+
+	for (i=1; i<n; ++i)
+		if (ELEM_LESS(v[i], v[i-1]))
+			return 0;
+
+	return 1;
+}
+
+UNUSED static void K(widen)(ELEM *v, const u64 *src, int n)
+{
+	int i;
+
+	for (i=0; i<n; ++i)
+		WIDEN(v, i, src[i]);
+}
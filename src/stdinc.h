@@ -35,10 +35,12 @@
 typedef uint8_t		u8;
 typedef uint16_t	u16;
 typedef uint32_t	u32;
+typedef uint64_t	u64;
 
 typedef int8_t		s8;
 typedef int16_t		s16;
 typedef int32_t		s32;
+typedef int64_t		s64;
 
 #ifdef NEED_BOOL
 typedef unsigned char   bool;
@@ -51,6 +53,7 @@ typedef unsigned char   bool;
 #define INLINE		__attribute__((always_inline))
 #define INLINE_METHOD	INLINE
 #define SENTINEL	__attribute__((sentinel))
+#define UNUSED		__attribute__((unused))
 #define CHECK_FMT	__attribute__((format(printf, 1, 2)))
 #define CHECK_FMT2	__attribute__((format(printf, 2, 3)))
 
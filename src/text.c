@@ -95,8 +95,8 @@ int text_set_text(Text *self, const char *fmt, ...)
 	int sz;
 
 	va_start(ap, fmt);
-
 	sz = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
 
 #if HAVE_ALLOCA
 	buf = alloca(sz+1);
@@ -104,6 +104,7 @@ int text_set_text(Text *self, const char *fmt, ...)
 	buf = malloc(sz+1);
 #endif
 
+	va_start(ap, fmt);
 	vsprintf(buf, fmt, ap);
 	va_end(ap);
 
@@ -0,0 +1,130 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <SDL_timer.h>
+
+#include "log.h"
+#include "trace.h"
+
+#define CACHELINE	64
+
+struct _Trace {
+	TraceEvent *ring;
+	u32 mask;
+
+	/* producer's cache line: */
+	u32 head __attribute__((aligned(CACHELINE)));
+	u32 tail_cache;
+
+	/* consumer's cache line: */
+	u32 tail __attribute__((aligned(CACHELINE)));
+	bool closed;
+};
+
+Trace *trace_new(u8 order)
+{
+	Trace *self;
+
+	if (posix_memalign((void **)&self, CACHELINE, sizeof(Trace)) != 0) {
+		log_err("could not allocate trace");
+		return NULL;
+	}
+
+	memset(self, 0, sizeof(Trace));
+
+	self->mask = (1U << order) - 1;
+	self->ring = malloc(sizeof(TraceEvent) << order);
+	if (!self->ring) {
+		log_err("could not allocate a trace of %u events", 1U << order);
+		free(self);
+		return NULL;
+	}
+
+	return self;
+}
+
+void trace_free(Trace *self)
+{
+	if (self) {
+		free(self->ring);
+		free(self);
+	}
+}
+
+INLINE void trace_reset(Trace *self)
+{
+	self->head = 0;
+	self->tail = 0;
+	self->tail_cache = 0;
+	self->closed = 0;
+}
+
+INLINE void trace_close(Trace *self)
+{
+	__atomic_store_n(&self->closed, 1, __ATOMIC_RELEASE);
+}
+
+INLINE bool trace_is_closed(Trace *self)
+{
+	return __atomic_load_n(&self->closed, __ATOMIC_ACQUIRE);
+}
+
+void trace_push(Trace *self, u8 op, u32 a, u32 b)
+{
+	TraceEvent *e;
+	u32 head;
+
+	head = self->head;
+
+	/* the consumer's index is read only when the ring looks full: */
+	while (head - self->tail_cache > self->mask) {
+		self->tail_cache = __atomic_load_n(&self->tail,
+						   __ATOMIC_ACQUIRE);
+		if (head - self->tail_cache <= self->mask)
+			break;
+
+		if (trace_is_closed(self))
+			return;
+
+		SDL_Delay(1);
+	}
+
+	e = &self->ring[head & self->mask];
+	e->a = ((u32)op << TRACE_OP_SHIFT) | a;
+	e->b = b;
+
+	__atomic_store_n(&self->head, head + 1, __ATOMIC_RELEASE);
+}
+
+u32 trace_pop(Trace *self, TraceEvent *buf, u32 max)
+{
+	u32 head, tail, count, i;
+
+	tail = self->tail;
+	head = __atomic_load_n(&self->head, __ATOMIC_ACQUIRE);
+
+	count = head - tail;
+	if (count > max)
+		count = max;
+
+	for (i=0; i<count; ++i)
+		buf[i] = self->ring[(tail + i) & self->mask];
+
+	__atomic_store_n(&self->tail, tail + count, __ATOMIC_RELEASE);
+
+	return count;
+}
@@ -0,0 +1,93 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "stdinc.h"
+
+/*
+ * Single-producer/single-consumer lock-free ring of sort operations.
+ *
+ * The sort thread pushes one event per elementary operation and the
+ * renderer pops them at its own pace to replay the sort on a copy of the
+ * data. Neither side ever takes a lock: the producer only writes `head',
+ * the consumer only writes `tail'.
+ */
+
+enum TraceOp {
+	TRACE_CMP,		/* compare v[a] with v[b] */
+	TRACE_SWAP,		/* swap v[a] with v[b] */
+	TRACE_WRITE,		/* store value b in v[a] */
+	TRACE_RANGE,		/* the worker now sorts v[a..b] (none if a > b) */
+	TRACE_WORKER,		/* next events come from worker a */
+	TRACE_RUN,		/* v[a..b] is a sorted run */
+};
+
+#define TRACE_OP_SHIFT	29
+#define TRACE_INDEX_MAX	((1U << TRACE_OP_SHIFT) - 1)
+
+/*
+ * Events are packed in 8 bytes: the operation lives in the three most
+ * significant bits of the first index.
+ */
+typedef struct {
+	u32 a;
+	u32 b;
+} TraceEvent;
+
+#define TRACE_EVENT_OP(E)	((E).a >> TRACE_OP_SHIFT)
+#define TRACE_EVENT_A(E)	((E).a & TRACE_INDEX_MAX)
+#define TRACE_EVENT_B(E)	((E).b)
+
+typedef struct _Trace Trace;
+
+/*
+ * Trace ctor: the ring holds up to 2^`order' events.
+ * On error a NULL pointer is returned.
+ */
+Trace *trace_new  (u8 order);
+void   trace_free (Trace *self);
+
+/*
+ * Drop every pending event and reopen the trace.
+ * Neither the producer nor the consumer must be running.
+ */
+void trace_reset (Trace *self);
+
+/*
+ * Close the trace: this is how the consumer cancels the producer.
+ * From now on trace_push() never blocks and trace_is_closed() returns 1,
+ * so that the producer can bail out at its next safe point.
+ */
+void trace_close     (Trace *self);
+bool trace_is_closed (Trace *self);
+
+/*
+ * Producer side: append an event, waiting as long as the ring is full
+ * (events pushed to a closed trace may be dropped).
+ * Several producers must serialize their calls.
+ */
+void trace_push (Trace *self, u8 op, u32 a, u32 b);
+
+/*
+ * Consumer side: move up to `max' pending events to `buf' and return how
+ * many were moved (0 if the ring is empty).
+ */
+u32 trace_pop (Trace *self, TraceEvent *buf, u32 max);
+
+#endif /* !TRACE_H */
@@ -0,0 +1,356 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "vpart.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+# define VPART_X86
+# include <immintrin.h>
+#endif
+
+static const char *VPART_STRISA[VPART_ISA_COUNT] = {
+	"scalar", "AVX2", "AVX-512",
+};
+
+static int detected = -1;		/* VpartIsa, once known */
+static bool vbmi2;			/* u16 compress-stores, likewise */
+static VpartIsa isa_max = VPART_AVX512;
+
+#ifdef VPART_X86
+
+#define AVX2	__attribute__((target("avx2,bmi2,popcnt")))
+#define AVX512	__attribute__((target("avx512f,popcnt")))
+#define AVX512_U16 __attribute__((target("avx512f,avx512bw,avx512vbmi2,popcnt")))
+
+/*
+ * In-place partition of v[0..n-1] (n >= 2*W), `W' keys at a time.
+ *
+ * The first and the last vectors are set aside, so that there are 2*W
+ * free slots between the write and the read ends. The next vector is
+ * read from the side with less free slots, which leaves at least W free
+ * slots on both sides for STORE() to write it; the keys left when less
+ * than a vector remains are moved one by one and the two vectors set
+ * aside are stored last.
+ */
+#define PARTITION(NAME, TARGET, T, W, VEC, LOAD, SPLAT, STORE)		\
+TARGET static int NAME(T *v, int n, T pivot, bool le)			\
+{									\
+	T tail[W];							\
+	VEC pv, first, last, x;						\
+	int rl, rr, wl, wr, i;						\
+									\
+	pv = SPLAT(pivot);						\
+	first = LOAD(v);						\
+	last = LOAD(v + n - (W));					\
+									\
+	rl = W;								\
+	rr = n - (W);							\
+	wl = 0;								\
+	wr = n;								\
+									\
+	while (rr - rl >= (W)) {					\
+		if (rl - wl <= wr - rr) {				\
+			x = LOAD(v + rl);				\
+			rl += W;					\
+		}							\
+		else {							\
+			rr -= W;					\
+			x = LOAD(v + rr);				\
+		}							\
+									\
+		STORE(v, &wl, &wr, x, pv, le);				\
+	}								\
+									\
+	memcpy(tail, v + rl, (rr - rl) * sizeof(T));			\
+	for (i=0; i<rr-rl; ++i) {					\
+		if (le ? tail[i] <= pivot : tail[i] < pivot)		\
+			v[wl++] = tail[i];				\
+		else							\
+			v[--wr] = tail[i];				\
+	}								\
+									\
+	STORE(v, &wl, &wr, first, pv, le);				\
+	STORE(v, &wl, &wr, last, pv, le);				\
+									\
+	return wl;							\
+}
+
+/*
+ * Byte indices of the `lanes' (up to 8) lanes, those set in `mask' first.
+ */
+AVX2 INLINE static u64 lane_order(u32 mask, int lanes)
+{
+	const u64 identity = 0x0706050403020100ULL;
+	u64 all, sel;
+	int nl;
+
+	nl = __builtin_popcount(mask);
+	if (nl == 8)
+		return identity;
+
+	all = lanes == 8 ? ~0ULL : (1ULL << 8*lanes) - 1;
+	sel = _pdep_u64(mask, 0x0101010101010101ULL) * 0xff;
+
+	return _pext_u64(identity, sel) |
+		_pext_u64(identity, ~sel & all) << 8*nl;
+}
+
+/*
+ * pshufb control moving the 16-bit lanes (or 32-bit, once widened) as
+ * the byte indices of `order' say.
+ */
+AVX2 INLINE static __m128i lane_bytes(u64 order)
+{
+	__m128i x = _mm_cvtsi64_si128(order);
+
+	x = _mm_unpacklo_epi8(x, x);
+
+	return _mm_add_epi8(_mm_add_epi8(x, x), _mm_set1_epi16(0x0100));
+}
+
+/*
+ * AVX2 has only signed comparisons: the keys are biased while in the
+ * registers. Both ends get the whole permuted vector, its left keys
+ * first and its right keys last.
+ */
+AVX2 INLINE static void store_u16_avx2(u16 *v, int *wl, int *wr, __m128i x,
+				       __m128i pv, bool le)
+{
+	const __m128i bias = _mm_set1_epi16(-0x8000);
+	__m128i y = _mm_xor_si128(x, bias), c;
+	u32 m;
+	int nl;
+
+	c = le ? _mm_cmpgt_epi16(y, pv) : _mm_cmpgt_epi16(pv, y);
+	m = _mm_movemask_epi8(_mm_packs_epi16(c, _mm_setzero_si128()));
+	if (le)
+		m = ~m & 0xff;
+	nl = __builtin_popcount(m);
+
+	x = _mm_shuffle_epi8(x, lane_bytes(lane_order(m, 8)));
+	_mm_storeu_si128((__m128i *)(v + *wl), x);
+	_mm_storeu_si128((__m128i *)(v + *wr - 8), x);
+	*wl += nl;
+	*wr -= 8 - nl;
+}
+
+AVX2 INLINE static void store_u32_avx2(u32 *v, int *wl, int *wr, __m256i x,
+				       __m256i pv, bool le)
+{
+	const __m256i bias = _mm256_set1_epi32(0x80000000);
+	__m256i y = _mm256_xor_si256(x, bias), c, idx;
+	u32 m;
+	int nl;
+
+	c = le ? _mm256_cmpgt_epi32(y, pv) : _mm256_cmpgt_epi32(pv, y);
+	m = _mm256_movemask_ps(_mm256_castsi256_ps(c));
+	if (le)
+		m = ~m & 0xff;
+	nl = __builtin_popcount(m);
+
+	idx = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(lane_order(m, 8)));
+	x = _mm256_permutevar8x32_epi32(x, idx);
+	_mm256_storeu_si256((__m256i *)(v + *wl), x);
+	_mm256_storeu_si256((__m256i *)(v + *wr - 8), x);
+	*wl += nl;
+	*wr -= 8 - nl;
+}
+
+AVX2 INLINE static void store_u64_avx2(u64 *v, int *wl, int *wr, __m256i x,
+				       __m256i pv, bool le)
+{
+	const __m256i bias = _mm256_set1_epi64x(0x8000000000000000LL);
+	__m256i y = _mm256_xor_si256(x, bias), c, idx;
+	u32 m;
+	int nl;
+
+	c = le ? _mm256_cmpgt_epi64(y, pv) : _mm256_cmpgt_epi64(pv, y);
+	m = _mm256_movemask_pd(_mm256_castsi256_pd(c));
+	if (le)
+		m = ~m & 0xf;
+	nl = __builtin_popcount(m);
+
+	/* every 64-bit lane moves as two 32-bit ones: */
+	idx = _mm256_cvtepu8_epi32(lane_bytes(lane_order(m, 4)));
+	x = _mm256_permutevar8x32_epi32(x, idx);
+	_mm256_storeu_si256((__m256i *)(v + *wl), x);
+	_mm256_storeu_si256((__m256i *)(v + *wr - 4), x);
+	*wl += nl;
+	*wr -= 4 - nl;
+}
+
+/*
+ * AVX-512 compress-stores only the selected keys at either end: 16-bit
+ * keys need AVX512-VBMI2 (and AVX512-BW to compare them), the others
+ * AVX512-F alone.
+ */
+AVX512_U16 INLINE static void store_u16_avx512(u16 *v, int *wl, int *wr,
+					   __m512i x, __m512i pv, bool le)
+{
+	__mmask32 m;
+	int nl;
+
+	m = le ? _mm512_cmple_epu16_mask(x, pv) : _mm512_cmplt_epu16_mask(x, pv);
+	nl = __builtin_popcount(m);
+
+	_mm512_mask_compressstoreu_epi16(v + *wl, m, x);
+	_mm512_mask_compressstoreu_epi16(v + *wr - (32 - nl), ~m, x);
+	*wl += nl;
+	*wr -= 32 - nl;
+}
+
+AVX512 INLINE static void store_u32_avx512(u32 *v, int *wl, int *wr,
+					   __m512i x, __m512i pv, bool le)
+{
+	__mmask16 m;
+	int nl;
+
+	m = le ? _mm512_cmple_epu32_mask(x, pv) : _mm512_cmplt_epu32_mask(x, pv);
+	nl = __builtin_popcount(m);
+
+	_mm512_mask_compressstoreu_epi32(v + *wl, m, x);
+	_mm512_mask_compressstoreu_epi32(v + *wr - (16 - nl), ~m, x);
+	*wl += nl;
+	*wr -= 16 - nl;
+}
+
+AVX512 INLINE static void store_u64_avx512(u64 *v, int *wl, int *wr,
+					   __m512i x, __m512i pv, bool le)
+{
+	__mmask8 m;
+	int nl;
+
+	m = le ? _mm512_cmple_epu64_mask(x, pv) : _mm512_cmplt_epu64_mask(x, pv);
+	nl = __builtin_popcount(m);
+
+	_mm512_mask_compressstoreu_epi64(v + *wl, m, x);
+	_mm512_mask_compressstoreu_epi64(v + *wr - (8 - nl), ~m, x);
+	*wl += nl;
+	*wr -= 8 - nl;
+}
+
+#define LOAD128(P)	_mm_loadu_si128((const __m128i *)(P))
+#define LOAD256(P)	_mm256_loadu_si256((const __m256i *)(P))
+#define LOAD512(P)	_mm512_loadu_si512(P)
+
+#define SPLAT_U16_AVX2(X)	_mm_set1_epi16((X) ^ 0x8000)
+#define SPLAT_U32_AVX2(X)	_mm256_set1_epi32((X) ^ 0x80000000)
+#define SPLAT_U64_AVX2(X)	_mm256_set1_epi64x((X) ^ 0x8000000000000000ULL)
+
+PARTITION(part_u16_avx2, AVX2, u16, 8, __m128i, LOAD128, SPLAT_U16_AVX2,
+	  store_u16_avx2)
+PARTITION(part_u32_avx2, AVX2, u32, 8, __m256i, LOAD256, SPLAT_U32_AVX2,
+	  store_u32_avx2)
+PARTITION(part_u64_avx2, AVX2, u64, 4, __m256i, LOAD256, SPLAT_U64_AVX2,
+	  store_u64_avx2)
+PARTITION(part_u16_avx512, AVX512_U16, u16, 32, __m512i, LOAD512,
+	  _mm512_set1_epi16, store_u16_avx512)
+PARTITION(part_u32_avx512, AVX512, u32, 16, __m512i, LOAD512,
+	  _mm512_set1_epi32, store_u32_avx512)
+PARTITION(part_u64_avx512, AVX512, u64, 8, __m512i, LOAD512,
+	  _mm512_set1_epi64, store_u64_avx512)
+
+#endif /* VPART_X86 */
+
+VpartIsa vpart_get_isa(void)
+{
+	if (detected < 0) {
+		detected = VPART_SCALAR;
+
+#ifdef VPART_X86
+		if (__builtin_cpu_supports("avx2") &&
+		    __builtin_cpu_supports("bmi2") &&
+		    __builtin_cpu_supports("popcnt"))
+			detected = VPART_AVX2;
+
+		if (detected == VPART_AVX2 &&
+		    __builtin_cpu_supports("avx512f"))
+			detected = VPART_AVX512;
+
+		vbmi2 = detected == VPART_AVX512 &&
+			__builtin_cpu_supports("avx512bw") &&
+			__builtin_cpu_supports("avx512vbmi2");
+#endif
+	}
+
+	return (VpartIsa)detected < isa_max ? (VpartIsa)detected : isa_max;
+}
+
+VpartIsa vpart_get_isa_u16(void)
+{
+	VpartIsa isa = vpart_get_isa();
+
+	return isa == VPART_AVX512 && !vbmi2 ? VPART_AVX2 : isa;
+}
+
+INLINE void vpart_set_isa(VpartIsa isa)
+{
+	isa_max = isa;
+}
+
+INLINE const char *vpart_isa_name(VpartIsa isa)
+{
+	if (isa < 0 || isa >= VPART_ISA_COUNT)
+		return NULL;
+
+	return VPART_STRISA[isa];
+}
+
+#ifdef VPART_X86
+# define ISA_u16()	vpart_get_isa_u16()
+# define ISA_u32()	vpart_get_isa()
+# define ISA_u64()	vpart_get_isa()
+
+# define DISPATCH(T, V, N, PIVOT, LE)					\
+	switch (ISA_##T()) {						\
+	case VPART_AVX512:						\
+		if ((N) >= 2*64 / (int)sizeof(T))			\
+			return part_##T##_avx512(V, N, PIVOT, LE);	\
+		break;							\
+									\
+	case VPART_AVX2:						\
+		if ((N) >= 2*32 / (int)sizeof(T))			\
+			return part_##T##_avx2(V, N, PIVOT, LE);	\
+		break;							\
+									\
+	default:							\
+		break;							\
+	}
+#else
+# define DISPATCH(T, V, N, PIVOT, LE)	/* nothing */
+#endif
+
+int vpart_u16(u16 *v, int n, u16 pivot, bool le)
+{
+	DISPATCH(u16, v, n, pivot, le);
+
+	return -1;
+}
+
+int vpart_u32(u32 *v, int n, u32 pivot, bool le)
+{
+	DISPATCH(u32, v, n, pivot, le);
+
+	return -1;
+}
+
+int vpart_u64(u64 *v, int n, u64 pivot, bool le)
+{
+	DISPATCH(u64, v, n, pivot, le);
+
+	return -1;
+}
@@ -0,0 +1,72 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef VPART_H
+#define VPART_H
+
+#include "stdinc.h"
+
+/*
+ * Vectorized partition of unsigned keys.
+ *
+ * A vector of keys is compared against the broadcast pivot and stored at
+ * both write ends of the range: with AVX2 the keys are permuted so that
+ * the ones going left come first (the permutation is built from the
+ * comparison mask with BMI2), with AVX-512 they are compress-stored. The
+ * instruction set is chosen at run time, from what the CPU supports.
+ */
+
+typedef enum {
+	VPART_SCALAR,
+	VPART_AVX2,
+	VPART_AVX512,
+
+	VPART_ISA_COUNT
+} VpartIsa;
+
+/*
+ * Move the keys of v[0..n-1] less than `pivot' (not greater than it if
+ * `le') to the front, keeping none of the orders, and return how many they
+ * are.
+ * If the range is too small for the vectors or the CPU has no vector
+ * unit for these keys, the functions return -1 and leave v untouched:
+ * the caller partitions it on its own.
+ */
+int vpart_u16 (u16 *v, int n, u16 pivot, bool le);
+int vpart_u32 (u32 *v, int n, u32 pivot, bool le);
+int vpart_u64 (u64 *v, int n, u64 pivot, bool le);
+
+/*
+ * Return the instruction set the partitions run on. The u16 ones need
+ * AVX512-VBMI2 on top of AVX-512, and run on AVX2 without it: see
+ * vpart_get_isa_u16().
+ */
+VpartIsa vpart_get_isa     (void);
+VpartIsa vpart_get_isa_u16 (void);
+
+/*
+ * Use at most the instruction set `isa' (VPART_SCALAR turns the vector
+ * partitions off), to compare them with their fallback.
+ */
+void vpart_set_isa (VpartIsa isa);
+
+/*
+ * Human readable names (NULL for unknown values).
+ */
+const char *vpart_isa_name (VpartIsa isa);
+
+#endif /* !VPART_H */
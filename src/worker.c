@@ -0,0 +1,155 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <SDL_thread.h>
+
+#include "log.h"
+#include "worker.h"
+
+#define QUEUE_SIZE	8
+
+typedef int (* ThreadFunc)(void *);
+
+typedef struct {
+	WorkFunc func;
+	void *arg;
+} Job;
+
+struct _Worker {
+	Job jobs[QUEUE_SIZE];
+	u8 first;
+	u8 count;
+	bool busy;
+	bool quit;
+
+	SDL_mutex *lock;
+	SDL_cond *has_work;
+	SDL_cond *has_room;
+	SDL_cond *idle;
+
+	SDL_Thread *thd;
+};
+
+static int worker_main(Worker *self)
+{
+	Job job;
+
+	SDL_mutexP(self->lock);
+
+	for (;;) {
+		while (!self->count && !self->quit)
+			SDL_CondWait(self->has_work, self->lock);
+
+		if (!self->count)
+			break;
+
+		job = self->jobs[self->first];
+		self->first = (self->first + 1) % QUEUE_SIZE;
+		--self->count;
+		self->busy = 1;
+		SDL_CondSignal(self->has_room);
+
+		SDL_mutexV(self->lock);
+		job.func(job.arg);
+		SDL_mutexP(self->lock);
+
+		self->busy = 0;
+		if (!self->count)
+			SDL_CondBroadcast(self->idle);
+	}
+
+	SDL_mutexV(self->lock);
+
+	return 0;
+}
+
+Worker *worker_new(void)
+{
+	Worker *self;
+
+	self = calloc(1, sizeof(Worker));
+	if (!self)
+		return NULL;
+
+	self->lock = SDL_CreateMutex();
+	self->has_work = SDL_CreateCond();
+	self->has_room = SDL_CreateCond();
+	self->idle = SDL_CreateCond();
+	if (!self->lock || !self->has_work || !self->has_room || !self->idle) {
+		log_err("could not create worker locks: %s", SDL_GetError());
+		worker_free(self);
+		return NULL;
+	}
+
+	self->thd = SDL_CreateThread((ThreadFunc)worker_main, self);
+	if (!self->thd) {
+		log_err("could not create worker thread: %s", SDL_GetError());
+		worker_free(self);
+		return NULL;
+	}
+
+	return self;
+}
+
+void worker_free(Worker *self)
+{
+	if (!self)
+		return;
+
+	if (self->thd) {
+		SDL_mutexP(self->lock);
+		self->quit = 1;
+		SDL_CondSignal(self->has_work);
+		SDL_mutexV(self->lock);
+
+		SDL_WaitThread(self->thd, NULL);
+	}
+
+	SDL_DestroyCond(self->idle);
+	SDL_DestroyCond(self->has_room);
+	SDL_DestroyCond(self->has_work);
+	SDL_DestroyMutex(self->lock);
+	free(self);
+}
+
+void worker_submit(Worker *self, WorkFunc f, void *arg)
+{
+	Job *job;
+
+	SDL_mutexP(self->lock);
+
+	while (self->count == QUEUE_SIZE)
+		SDL_CondWait(self->has_room, self->lock);
+
+	job = &self->jobs[(self->first + self->count) % QUEUE_SIZE];
+	job->func = f;
+	job->arg = arg;
+	++self->count;
+
+	SDL_CondSignal(self->has_work);
+	SDL_mutexV(self->lock);
+}
+
+void worker_wait(Worker *self)
+{
+	SDL_mutexP(self->lock);
+
+	while (self->count || self->busy)
+		SDL_CondWait(self->idle, self->lock);
+
+	SDL_mutexV(self->lock);
+}
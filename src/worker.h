@@ -0,0 +1,53 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef WORKER_H
+#define WORKER_H
+
+#include "stdinc.h"
+
+/*
+ * Long-lived background thread running jobs from a FIFO queue.
+ */
+
+typedef struct _Worker Worker;
+typedef void (*WorkFunc)(void *);
+
+/*
+ * Worker ctor: the thread is started here and lives until worker_free().
+ * On error a NULL pointer is returned.
+ */
+Worker *worker_new (void);
+
+/*
+ * Worker dtor: wait for the queued jobs to complete, then join the thread.
+ * Jobs which can take long should be cancelled by the caller beforehand.
+ */
+void worker_free (Worker *self);
+
+/*
+ * Queue a job: `f(arg)' will be invoked by the worker thread.
+ * If the queue is full the call blocks until a slot is available.
+ */
+void worker_submit (Worker *self, WorkFunc f, void *arg);
+
+/*
+ * Wait until every queued job has completed.
+ */
+void worker_wait (Worker *self);
+
+#endif /* !WORKER_H */
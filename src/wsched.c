@@ -0,0 +1,343 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sched.h>
+
+#include <SDL_thread.h>
+
+#include "log.h"
+#include "wsched.h"
+
+#define CACHELINE	64
+#define DEQUE_ORDER	12
+#define DEQUE_SIZE	(1 << DEQUE_ORDER)
+#define DEQUE_MASK	(DEQUE_SIZE - 1)
+#define SPIN_TRIES	64
+
+typedef int (* ThreadFunc)(void *);
+
+/*
+ * Chase-Lev deque with a fixed capacity: the owner works at `bottom',
+ * thieves at `top'.
+ */
+typedef struct {
+	s64 top __attribute__((aligned(CACHELINE)));
+	s64 bottom __attribute__((aligned(CACHELINE)));
+	Task tasks[DEQUE_SIZE];
+} Deque;
+
+typedef struct {
+	Sched *sched;
+	u32 id;
+} Helper;
+
+struct _Sched {
+	u32 nthreads;
+	Deque *deques;
+
+	u32 pending __attribute__((aligned(CACHELINE)));
+
+	SDL_mutex *lock;
+	SDL_cond *start;
+	SDL_cond *done;
+	u32 epoch;
+	u32 busy;
+	bool quit;
+
+	Helper helpers[SCHED_MAX_THREADS];
+	SDL_Thread *thds[SCHED_MAX_THREADS];
+};
+
+static __thread u32 self_id;
+
+INLINE static void task_store(Task *dst, const Task *src)
+{
+	__atomic_store_n(&dst->func, src->func, __ATOMIC_RELAXED);
+	__atomic_store_n(&dst->ctx, src->ctx, __ATOMIC_RELAXED);
+	__atomic_store_n(&dst->a, src->a, __ATOMIC_RELAXED);
+	__atomic_store_n(&dst->b, src->b, __ATOMIC_RELAXED);
+}
+
+INLINE static void task_load(Task *dst, const Task *src)
+{
+	dst->func = __atomic_load_n(&src->func, __ATOMIC_RELAXED);
+	dst->ctx = __atomic_load_n(&src->ctx, __ATOMIC_RELAXED);
+	dst->a = __atomic_load_n(&src->a, __ATOMIC_RELAXED);
+	dst->b = __atomic_load_n(&src->b, __ATOMIC_RELAXED);
+}
+
+static bool deque_push(Deque *d, const Task *t)
+{
+	s64 b, top;
+
+	b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+	top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+	if (b - top >= DEQUE_SIZE)
+		return 0;
+
+	task_store(&d->tasks[b & DEQUE_MASK], t);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+
+	return 1;
+}
+
+static bool deque_pop(Deque *d, Task *t)
+{
+	s64 b, top;
+	bool retv;
+
+	b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+	__atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	top = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+	if (top > b) {
+		__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	task_load(t, &d->tasks[b & DEQUE_MASK]);
+	if (top < b)
+		return 1;
+
+	/* last task: race against the thieves */
+	retv = __atomic_compare_exchange_n(&d->top, &top, top + 1, 0,
+					   __ATOMIC_SEQ_CST,
+					   __ATOMIC_RELAXED);
+	__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+
+	return retv;
+}
+
+static bool deque_steal(Deque *d, Task *t)
+{
+	s64 b, top;
+
+	top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+
+	if (top >= b)
+		return 0;
+
+	task_load(t, &d->tasks[top & DEQUE_MASK]);
+
+	return __atomic_compare_exchange_n(&d->top, &top, top + 1, 0,
+					   __ATOMIC_SEQ_CST,
+					   __ATOMIC_RELAXED);
+}
+
+/*
+ * Look for a task in the other workers' deques, starting from a victim
+ * which changes at every attempt.
+ */
+static bool steal(Sched *self, u32 id, u32 *victim, Task *t)
+{
+	u32 i, k;
+
+	for (i=1; i<self->nthreads; ++i) {
+		k = (id + *victim + i) % self->nthreads;
+		if (k != id && deque_steal(&self->deques[k], t)) {
+			*victim = k;
+			return 1;
+		}
+	}
+
+	++*victim;
+
+	return 0;
+}
+
+/*
+ * Run tasks as worker `id' until every task of the current run completed.
+ */
+static void sched_work(Sched *self, u32 id)
+{
+	Task t;
+	u32 victim, idle;
+
+	self_id = id;
+	victim = id;
+	idle = 0;
+
+	while (__atomic_load_n(&self->pending, __ATOMIC_ACQUIRE)) {
+		if (deque_pop(&self->deques[id], &t) ||
+		    steal(self, id, &victim, &t)) {
+			t.func(&t);
+			__atomic_sub_fetch(&self->pending, 1, __ATOMIC_ACQ_REL);
+			idle = 0;
+		}
+		else if (++idle > SPIN_TRIES) {
+			sched_yield();
+		}
+	}
+}
+
+static int helper_main(Helper *helper)
+{
+	Sched *self = helper->sched;
+	u32 seen = 0;
+
+	SDL_mutexP(self->lock);
+
+	for (;;) {
+		while (self->epoch == seen && !self->quit)
+			SDL_CondWait(self->start, self->lock);
+
+		if (self->quit)
+			break;
+
+		seen = self->epoch;
+		++self->busy;
+		SDL_mutexV(self->lock);
+
+		sched_work(self, helper->id);
+
+		SDL_mutexP(self->lock);
+		if (!--self->busy)
+			SDL_CondBroadcast(self->done);
+	}
+
+	SDL_mutexV(self->lock);
+
+	return 0;
+}
+
+Sched *sched_new(u32 nthreads)
+{
+	Sched *self;
+	u32 i;
+
+	if (!nthreads || nthreads > SCHED_MAX_THREADS) {
+		log_err("sched: thread count must be in 1..%d",
+			SCHED_MAX_THREADS);
+		return NULL;
+	}
+
+	if (posix_memalign((void **)&self, CACHELINE, sizeof(Sched)) != 0) {
+		log_err("sched: could not allocate scheduler");
+		return NULL;
+	}
+
+	memset(self, 0, sizeof(Sched));
+
+	if (posix_memalign((void **)&self->deques, CACHELINE,
+			   nthreads * sizeof(Deque)) != 0) {
+		log_err("sched: could not allocate %u workers", nthreads);
+		free(self);
+		return NULL;
+	}
+
+	memset(self->deques, 0, nthreads * sizeof(Deque));
+	self->nthreads = nthreads;
+
+	self->lock = SDL_CreateMutex();
+	self->start = SDL_CreateCond();
+	self->done = SDL_CreateCond();
+	if (!self->lock || !self->start || !self->done) {
+		log_err("sched: could not create locks: %s", SDL_GetError());
+		sched_free(self);
+		return NULL;
+	}
+
+	for (i=1; i<nthreads; ++i) {
+		self->helpers[i].sched = self;
+		self->helpers[i].id = i;
+		self->thds[i] = SDL_CreateThread((ThreadFunc)helper_main,
+						 &self->helpers[i]);
+		if (!self->thds[i]) {
+			log_err("sched: could not create thread: %s",
+				SDL_GetError());
+			sched_free(self);
+			return NULL;
+		}
+	}
+
+	return self;
+}
+
+void sched_free(Sched *self)
+{
+	u32 i;
+
+	if (!self)
+		return;
+
+	/* no helper was started without the locks: */
+	if (self->lock && self->start) {
+		SDL_mutexP(self->lock);
+		self->quit = 1;
+		SDL_CondBroadcast(self->start);
+		SDL_mutexV(self->lock);
+	}
+
+	for (i=1; i<self->nthreads; ++i)
+		if (self->thds[i])
+			SDL_WaitThread(self->thds[i], NULL);
+
+	SDL_DestroyCond(self->done);
+	SDL_DestroyCond(self->start);
+	SDL_DestroyMutex(self->lock);
+	free(self->deques);
+	free(self);
+}
+
+INLINE u32 sched_get_threads(const Sched *self)
+{
+	return self->nthreads;
+}
+
+void sched_run(Sched *self, TaskFunc func, void *ctx, u32 a, u32 b)
+{
+	Task t = { func, ctx, a, b };
+
+	self->pending = 1;
+	deque_push(&self->deques[0], &t);
+
+	if (self->nthreads > 1) {
+		SDL_mutexP(self->lock);
+		++self->epoch;
+		SDL_CondBroadcast(self->start);
+		SDL_mutexV(self->lock);
+	}
+
+	sched_work(self, 0);
+
+	/* helpers must be out of the deques before the next run: */
+	SDL_mutexP(self->lock);
+	while (self->busy)
+		SDL_CondWait(self->done, self->lock);
+	SDL_mutexV(self->lock);
+}
+
+void sched_spawn(Sched *self, TaskFunc func, void *ctx, u32 a, u32 b)
+{
+	Task t = { func, ctx, a, b };
+
+	__atomic_add_fetch(&self->pending, 1, __ATOMIC_ACQ_REL);
+
+	if (!deque_push(&self->deques[self_id], &t)) {
+		func(&t);
+		__atomic_sub_fetch(&self->pending, 1, __ATOMIC_ACQ_REL);
+	}
+}
+
+INLINE u32 sched_self(void)
+{
+	return self_id;
+}
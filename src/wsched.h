@@ -0,0 +1,72 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef WSCHED_H
+#define WSCHED_H
+
+#include "stdinc.h"
+
+/*
+ * Work-stealing task scheduler.
+ *
+ * Every worker owns a deque of tasks: it pushes and pops at the bottom,
+ * while idle workers steal from the top of the others' deques. The thread
+ * calling sched_run() takes part as worker 0, the other workers are
+ * long-lived threads created by sched_new().
+ */
+
+#define SCHED_MAX_THREADS	64
+
+typedef struct _Sched Sched;
+typedef struct _Task Task;
+
+typedef void (*TaskFunc)(const Task *);
+
+struct _Task {
+	TaskFunc func;
+	void *ctx;
+	u32 a;
+	u32 b;
+};
+
+/*
+ * Sched ctor: `nthreads' workers (up to SCHED_MAX_THREADS) in total.
+ * On error a NULL pointer is returned.
+ */
+Sched *sched_new  (u32 nthreads);
+void   sched_free (Sched *self);
+
+u32 sched_get_threads (const Sched *self);
+
+/*
+ * Run `func' with the given arguments and every task it spawns, then
+ * return when all of them have completed.
+ */
+void sched_run (Sched *self, TaskFunc func, void *ctx, u32 a, u32 b);
+
+/*
+ * Spawn a task from inside a running task. If the deque of the calling
+ * worker is full the task is run immediately.
+ */
+void sched_spawn (Sched *self, TaskFunc func, void *ctx, u32 a, u32 b);
+
+/*
+ * Return the index of the worker running the calling task.
+ */
+u32 sched_self (void);
+
+#endif /* !WSCHED_H */